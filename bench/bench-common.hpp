@@ -0,0 +1,100 @@
+/*
+ * Benchmark Helpers of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#ifndef BENCH_COMMON_HPP
+#define BENCH_COMMON_HPP
+
+#include <chrono>
+#include <cstddef>
+#include <cstdint>
+#include <cstdio>
+#include "midi-state-machine.hpp"
+
+/*
+ * Switch on voice_count notes spread evenly over the whole MIDI pitch
+ * range, such that both cheap low and expensive high pitches are part
+ * of each measurement.
+ */
+static inline void
+note_on_spread(MIDI_state_machine *midi_state_machine,
+               const size_t voice_count, const uint8_t velocity = 100)
+{
+  const size_t num_osc = MIDI_state_machine::NUM_OSC;
+  for (size_t voice = 0; voice < voice_count; voice++) {
+    const uint8_t note_on[4] = {
+      0x09, 0x90, (uint8_t)(voice * num_osc / voice_count), velocity
+    };
+    midi_state_machine->consume_event_packet(note_on);
+  }
+}
+
+/*
+ * Let the state machine consume a channel message right away, bypassing
+ * the event queue.
+ */
+static inline void
+send(MIDI_state_machine *midi_state_machine, const uint8_t channel,
+     const uint8_t status, const uint8_t data1, const uint8_t data2 = 0x00)
+{
+  const uint8_t packet[4] = {
+    (uint8_t)(status >> 4), (uint8_t)(status | channel), data1, data2
+  };
+  midi_state_machine->consume_event_packet(packet);
+}
+
+/*
+ * Report a checked value and return whether it is the expected one.
+ */
+static inline bool
+expect(const char *what, const int32_t value, const int32_t expected)
+{
+  const bool ok = value == expected;
+  printf("%-28s %6d, expected %6d: %s\n",
+         what, value, expected, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+static inline double
+elapsed_ns(const std::chrono::steady_clock::time_point start)
+{
+  const auto stop = std::chrono::steady_clock::now();
+  return std::chrono::duration<double, std::nano>(stop - start).count();
+}
+
+#endif /* BENCH_COMMON_HPP */
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,283 @@
+/*
+ * Pitch Bend Check of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+
+/*
+ * Host check of pitch bend and portamento: compares the interpolated
+ * oscillator parameters of all pitches in 1/256 semitones at all
+ * sample rates against the exact math, verifies the frequencies of
+ * bent and gliding notes played through the MIDI state machine, and
+ * reports the cost of a dense bend sweep.
+ */
+
+#include <chrono>
+#include <cmath>
+#include <cstdio>
+#include <cstdlib>
+#include "bench-common.hpp"
+#include "osc-tables.hpp"
+#include "synth-renderer.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint8_t CHANNEL = 0x0;
+static const uint32_t BENCH_SECONDS = 5;
+static const uint32_t TICK_FRAMES = MIDI_state_machine::ENVELOPE_TICK_FRAMES;
+static const uint8_t PITCH_BITS = Osc_tables::PITCH_FRACTION_BITS;
+// half a pitch step of 1/256 semitone, for notes in the middle range
+static const double MAX_CENTS = 0.25;
+
+// controller value 0x3c selects 2^6 = 64ms
+static const uint32_t GLIDE_FRAMES = 64 * SAMPLE_FREQ / 1000;
+
+static double
+exact_freq(const double note)
+{
+  return 440.0 * exp2((note - 69.0) / 12.0);
+}
+
+static double
+exact_value(const double note, const uint32_t sample_freq)
+{
+#ifdef USE_DDS_OSC
+  return 4294967296.0 * exact_freq(note) / sample_freq;
+#else
+  return 0.5 * MIDI_state_machine::COUNT_INC * sample_freq / exact_freq(note);
+#endif
+}
+
+static double
+osc_freq(MIDI_state_machine *midi_state_machine, const uint8_t osc)
+{
+  const MIDI_state_machine::osc_bank_t *osc_bank =
+    midi_state_machine->get_osc_bank();
+#ifdef USE_DDS_OSC
+  return osc_bank->phase_inc[osc] * (double)SAMPLE_FREQ / 4294967296.0;
+#else
+  return (double)SAMPLE_FREQ * MIDI_state_machine::COUNT_INC /
+    (osc_bank->count_wrap[osc] + osc_bank->count_wrap_next[osc]);
+#endif
+}
+
+/*
+ * Interpolated values may deviate from the exact math by just the
+ * rounding of the note's table value (scaled by less than a
+ * semitone) plus the rounding of the multiplication, i.e. just over
+ * one unit, and by the linear interpolation between fine steps of
+ * 1/32 semitone, which stays below one part per million.
+ */
+static const double MAX_ROUNDING_ERROR = 1.1;
+static const double MAX_INTERPOLATION_ERROR = 1e-6;
+
+static bool
+check_tables()
+{
+  bool ok = true;
+  for (const uint32_t sample_freq : Osc_tables::SAMPLE_FREQS) {
+    const uint32_t *osc_table = Osc_tables::lookup(sample_freq);
+    double max_error = 0.0;
+    double max_cents = 0.0;
+    bool table_ok = true;
+    for (int32_t pitch = 0; pitch <= Osc_tables::MAX_PITCH; pitch++) {
+      const double note = (double)pitch / (1 << PITCH_BITS);
+      const double exact = exact_value(note, sample_freq);
+      const double value = Osc_tables::pitch_value(osc_table, pitch);
+      const double error = fabs(value - exact);
+      const double cents = 1200.0 * fabs(log2(value / exact));
+      table_ok &=
+        error <= MAX_ROUNDING_ERROR + MAX_INTERPOLATION_ERROR * exact;
+      max_error = error > max_error ? error : max_error;
+      max_cents = cents > max_cents ? cents : max_cents;
+    }
+    printf("%5u Hz table: max error %.3f units (%.4f cents) "
+           "over %d pitches: %s\n", sample_freq, max_error, max_cents,
+           Osc_tables::MAX_PITCH + 1, table_ok ? "ok" : "FAILED");
+    ok &= table_ok;
+  }
+  return ok;
+}
+
+static bool
+expect_freq(const char *what, const double freq, const double note)
+{
+  const double cents = 1200.0 * log2(freq / exact_freq(note));
+  const bool ok = fabs(cents) <= MAX_CENTS;
+  printf("%-24s %10.4f Hz, expected %10.4f Hz (%+.4f cents): %s\n",
+         what, freq, exact_freq(note), cents, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+static bool
+check_bend()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  Synth_renderer renderer(&midi_state_machine);
+  int16_t out[2 * TICK_FRAMES];
+  const uint8_t pitch = 60;
+  bool ok = true;
+  send(&midi_state_machine, CHANNEL, 0x90, pitch, 0x7f);
+  send(&midi_state_machine, CHANNEL, 0xe0, 0x7f, 0x7f); // 8191 / 8192 up
+  renderer.render(out, TICK_FRAMES, true);
+  ok &= expect_freq("bend +2", osc_freq(&midi_state_machine, pitch),
+                    pitch + 2.0 * 8191 / 8192);
+  // RPN 0: bend range of 12 semitones
+  send(&midi_state_machine, CHANNEL, 0xb0, 0x65, 0x00);
+  send(&midi_state_machine, CHANNEL, 0xb0, 0x64, 0x00);
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_DATA_ENTRY, 12);
+  send(&midi_state_machine, CHANNEL, 0xe0, 0x00, 0x00); // 8192 down
+  renderer.render(out, TICK_FRAMES, true);
+  ok &= expect_freq("bend -12", osc_freq(&midi_state_machine, pitch),
+                    pitch - 12.0);
+  // 0x1533 - 0x2000 of 12
+  send(&midi_state_machine, CHANNEL, 0xe0, 0x33, 0x2a);
+  renderer.render(out, TICK_FRAMES, true);
+  ok &= expect_freq("bend -4.2", osc_freq(&midi_state_machine, pitch),
+                    pitch + 12.0 * (0x1533 - 0x2000) / 8192);
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_DATA_ENTRY, 0x7f);
+  send(&midi_state_machine, CHANNEL, 0xe0, 0x00, 0x00);
+  renderer.render(out, TICK_FRAMES, true);
+  ok &= expect_freq("bend -24 (clamped)", osc_freq(&midi_state_machine, pitch),
+                    pitch - 24.0);
+  send(&midi_state_machine, CHANNEL, 0xe0, 0x00, 0x40);
+  renderer.render(out, TICK_FRAMES, true);
+  ok &= expect_freq("bend center", osc_freq(&midi_state_machine, pitch),
+                    pitch);
+  return ok;
+}
+
+/*
+ * The glide starts at the previous note, passes the middle after half
+ * the portamento time, and ends on the new note within one tick of
+ * the portamento time.
+ */
+static bool
+check_glide()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  Synth_renderer renderer(&midi_state_machine);
+  int16_t out[2 * TICK_FRAMES];
+  const uint8_t from = 48;
+  const uint8_t to = 60;
+  bool ok = true;
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_PORTAMENTO_TIME, 0x3c);
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_PORTAMENTO, 0x7f);
+  send(&midi_state_machine, CHANNEL, 0x90, from, 0x7f);
+  send(&midi_state_machine, CHANNEL, 0x80, from, 0x00);
+  send(&midi_state_machine, CHANNEL, 0x90, to, 0x7f);
+  ok &= expect_freq("glide start", osc_freq(&midi_state_machine, to), from);
+  uint32_t frames = 0;
+  while (frames < GLIDE_FRAMES / 2) {
+    renderer.render(out, TICK_FRAMES, true);
+    frames += TICK_FRAMES;
+  }
+  const double middle = 0.5 * (from + to);
+  const double cents =
+    1200.0 * log2(osc_freq(&midi_state_machine, to) / exact_freq(middle));
+  const bool middle_ok = fabs(cents) <= 100.0 * TICK_FRAMES * (to - from) /
+    GLIDE_FRAMES;
+  printf("%-24s %10.4f Hz, expected %10.4f Hz (%+.4f cents): %s\n",
+         "glide middle", osc_freq(&midi_state_machine, to),
+         exact_freq(middle), cents, middle_ok ? "ok" : "FAILED");
+  ok &= middle_ok;
+  while (midi_state_machine.has_ramping_voices() &&
+         (frames < SAMPLE_FREQ)) {
+    renderer.render(out, TICK_FRAMES, true);
+    frames += TICK_FRAMES;
+  }
+  const bool time_ok = (frames + TICK_FRAMES >= GLIDE_FRAMES) &&
+    (frames <= GLIDE_FRAMES + 2 * TICK_FRAMES);
+  printf("%-24s %6u frames, expected %6u: %s\n", "glide time", frames,
+         GLIDE_FRAMES, time_ok ? "ok" : "FAILED");
+  ok &= time_ok;
+  ok &= expect_freq("glide end", osc_freq(&midi_state_machine, to), to);
+  return ok;
+}
+
+/*
+ * Render in chunks of BEND_FRAMES, sweeping the bend of the channel
+ * over its full range with a bend message before each chunk, or not
+ * at all.
+ */
+static const uint32_t BEND_FRAMES = 16;
+
+static double
+bench_ns_per_frame(const size_t voice_count, const bool sweep)
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  note_on_spread(&midi_state_machine, voice_count);
+  Synth_renderer renderer(&midi_state_machine);
+  int16_t out[2 * BEND_FRAMES];
+  const uint32_t chunk_count = BENCH_SECONDS * SAMPLE_FREQ / BEND_FRAMES;
+  volatile int16_t sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t chunk = 0; chunk < chunk_count; chunk++) {
+    if (sweep) {
+      const uint16_t bend = (chunk * 0x40) & 0x3fff;
+      send(&midi_state_machine, CHANNEL, 0xe0, bend & 0x7f, bend >> 7);
+    }
+    renderer.render(out, BEND_FRAMES, true);
+    sink = sink + out[chunk % (2 * BEND_FRAMES)];
+  }
+  return elapsed_ns(start) / ((double)chunk_count * BEND_FRAMES);
+}
+
+int
+main()
+{
+  if (!check_tables() || !check_bend() || !check_glide()) {
+    return EXIT_FAILURE;
+  }
+  const size_t voice_counts[] = { 1, 8, 32, 128 };
+  printf("bend message every %u frames\n", BEND_FRAMES);
+  printf("%8s %18s %18s %10s\n",
+         "voices", "steady ns/fr", "sweep ns/fr", "overhead");
+  for (const size_t voice_count : voice_counts) {
+    const double steady_ns = bench_ns_per_frame(voice_count, false);
+    const double sweep_ns = bench_ns_per_frame(voice_count, true);
+    printf("%8zu %18.2f %18.2f %9.1f%%\n", voice_count, steady_ns,
+           sweep_ns, 100.0 * (sweep_ns - steady_ns) / steady_ns);
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,130 @@
+/*
+ * Channel Voice Check of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+
+/*
+ * Host check of the channel voice messages: verifies that the hold
+ * pedal keeps released notes sounding until it goes up, that volume
+ * and expression scale the elongations, that "reset all controllers"
+ * releases the pedal and restores the expression, and that program
+ * change, channel pressure and pitch bend end up in the channel
+ * state, all without rendering a single sample.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include "bench-common.hpp"
+#include "midi-state-machine.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint8_t CHANNEL = 0x3;
+static const uint8_t PITCH = 0x45;
+
+typedef MIDI_state_machine::channel_status_t channel_status_t;
+
+static int32_t
+elongation(MIDI_state_machine *midi_state_machine)
+{
+  return midi_state_machine->get_osc_bank()->elongation_left[PITCH];
+}
+
+int
+main()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  const channel_status_t *channel_status =
+    midi_state_machine.get_channel_status(CHANNEL);
+  bool ok = true;
+
+  // instant envelopes, such that each event takes full effect at once
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_ATTACK, 0x00);
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_RELEASE, 0x00);
+  send(&midi_state_machine, CHANNEL, 0x90, PITCH, 0x7f);
+  const int32_t full = elongation(&midi_state_machine);
+  ok &= expect("note on", full < 0 ? -full : full, 0x7f);
+
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_VOLUME, 0x40);
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_EXPRESSION, 0x40);
+  const int32_t quiet = elongation(&midi_state_machine);
+  ok &= expect("volume and expression", quiet < 0 ? -quiet : quiet,
+               0x7f * 0x40 * 0x40 / (0x7f * 0x7f));
+
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_HOLD, 0x7f);
+  send(&midi_state_machine, CHANNEL, 0x80, PITCH);
+  ok &= expect("held voices", midi_state_machine.get_voice_count(), 1);
+  ok &= expect("held key velocity",
+               midi_state_machine.get_note_velocity(CHANNEL, PITCH), 0);
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_HOLD, 0x00);
+  ok &= expect("voices after pedal up", midi_state_machine.get_voice_count(),
+               0);
+
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_HOLD, 0x7f);
+  send(&midi_state_machine, CHANNEL, 0x90, PITCH, 0x7f);
+  // note off by velocity 0
+  send(&midi_state_machine, CHANNEL, 0x90, PITCH, 0x00);
+  send(&midi_state_machine, CHANNEL, 0xe0, 0x00, 0x7f);
+  send(&midi_state_machine, CHANNEL, 0xc0, 0x11);
+  send(&midi_state_machine, CHANNEL, 0xd0, 0x22);
+  ok &= expect("bent voices", midi_state_machine.get_voice_count(), 1);
+  ok &= expect("pitch bend", channel_status->bend, 0x3f80);
+  ok &= expect("program", channel_status->program, 0x11);
+  ok &= expect("channel pressure", channel_status->pressure, 0x22);
+
+  send(&midi_state_machine, CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_RESET_ALL, 0x00);
+  ok &= expect("voices after reset", midi_state_machine.get_voice_count(), 0);
+  ok &= expect("bend after reset", channel_status->bend,
+               MIDI_state_machine::PITCH_BEND_CENTER);
+  ok &= expect("volume after reset",
+               channel_status->controllers
+               [MIDI_state_machine::CONTROLLER_VOLUME], 0x40);
+  ok &= expect("expression after reset",
+               channel_status->controllers
+               [MIDI_state_machine::CONTROLLER_EXPRESSION],
+               MIDI_state_machine::DEFAULT_EXPRESSION);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,266 @@
+/*
+ * Envelope Check of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+/*
+ * Host check of the voice envelopes: verifies that attack, decay and
+ * release of a single note take the times selected by their
+ * controllers within one envelope tick, and compares the rendering
+ * cost of voices while all of them ramp against all of them
+ * sustaining, i.e. the cost of the envelope ticks.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "bench-common.hpp"
+#include "synth-renderer.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint32_t BUFFER_FRAMES = 256;
+static const uint32_t BENCH_SECONDS = 5;
+static const uint32_t TICK_FRAMES = MIDI_state_machine::ENVELOPE_TICK_FRAMES;
+static const uint8_t PITCH = 0x45;
+
+// controller value 0x3c selects 2^6 = 64ms
+static const uint32_t RAMP_FRAMES = 64 * SAMPLE_FREQ / 1000;
+
+static void
+control_change(MIDI_state_machine *midi_state_machine,
+               const uint8_t controller, const uint8_t value)
+{
+  const uint8_t packet[4] = { 0x0b, 0xb0, controller, value };
+  midi_state_machine->consume_event_packet(packet);
+}
+
+static int32_t
+elongation(MIDI_state_machine *midi_state_machine)
+{
+  const int32_t elongation =
+    midi_state_machine->get_osc_bank()->elongation_left[PITCH];
+  return elongation < 0 ? -elongation : elongation;
+}
+
+static bool
+expect_frames(const char *stage, const uint32_t frames,
+              const uint32_t expected_frames)
+{
+  const bool ok =
+    (frames + TICK_FRAMES >= expected_frames) &&
+    (frames <= expected_frames + TICK_FRAMES);
+  printf("%-8s %6u frames, expected %6u +/- %u: %s\n",
+         stage, frames, expected_frames, TICK_FRAMES, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+/*
+ * Render tick by tick until the condition holds, returning the
+ * number of frames rendered.
+ */
+template<typename condition_t>
+static uint32_t
+render_until(Synth_renderer *renderer, const condition_t condition)
+{
+  int16_t out[2 * TICK_FRAMES];
+  uint32_t frames = 0;
+  while (!condition() && (frames < 10 * SAMPLE_FREQ)) {
+    renderer->render(out, TICK_FRAMES, true);
+    frames += TICK_FRAMES;
+  }
+  return frames;
+}
+
+static bool
+check_stages()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  control_change(&midi_state_machine, MIDI_state_machine::CONTROLLER_ATTACK,
+                 0x3c);
+  control_change(&midi_state_machine, MIDI_state_machine::CONTROLLER_DECAY,
+                 0x3c);
+  control_change(&midi_state_machine, MIDI_state_machine::CONTROLLER_SUSTAIN,
+                 0x40);
+  control_change(&midi_state_machine, MIDI_state_machine::CONTROLLER_RELEASE,
+                 0x3c);
+  Synth_renderer renderer(&midi_state_machine);
+  const uint8_t note_on[4] = { 0x09, 0x90, PITCH, 0x7f };
+  const uint8_t note_off[4] = { 0x08, 0x80, PITCH, 0x00 };
+  midi_state_machine.consume_event_packet(note_on);
+
+  // ramps cover the full level range, decay and release just parts
+  const int32_t full = 0x7f;
+  const uint32_t sustain_level =
+    (uint64_t)MIDI_state_machine::ENV_LEVEL_FULL * 0x40 / 0x7f;
+  const int32_t sustain =
+    (full * (sustain_level >> (MIDI_state_machine::ENV_LEVEL_BITS -
+                               MIDI_state_machine::ENV_GAIN_BITS))) >>
+    MIDI_state_machine::ENV_GAIN_BITS;
+  const uint32_t decay_frames = RAMP_FRAMES * (0x7f - 0x40) / 0x7f;
+  const uint32_t release_frames = RAMP_FRAMES * 0x40 / 0x7f;
+  bool ok = true;
+  const uint32_t attack = render_until(&renderer, [&]() {
+    return elongation(&midi_state_machine) == full;
+  });
+  ok &= expect_frames("attack", attack, RAMP_FRAMES);
+  const uint32_t decay = render_until(&renderer, [&]() {
+    return elongation(&midi_state_machine) == sustain;
+  });
+  ok &= expect_frames("decay", decay, decay_frames);
+  midi_state_machine.consume_event_packet(note_off);
+  const uint32_t release = render_until(&renderer, [&]() {
+    return !midi_state_machine.get_voice_count();
+  });
+  ok &= expect_frames("release", release, release_frames);
+  if (midi_state_machine.get_active_osc_count()) {
+    fprintf(stderr, "oscillator still active after release\n");
+    ok = false;
+  }
+  return ok;
+}
+
+#ifndef USE_DDS_OSC
+/*
+ * In count mode, the sign of the elongations tells the current half of
+ * the period, hence it must hold across envelope ticks, even while the
+ * level is close to 0, and while the LFO changes the duty cycle.  An
+ * uneven pulse tells both halves apart: the high half must come with
+ * positive elongations.
+ */
+static bool
+check_polarity()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  control_change(&midi_state_machine, MIDI_state_machine::CONTROLLER_ATTACK,
+                 0x50);
+  control_change(&midi_state_machine, MIDI_state_machine::CONTROLLER_RELEASE,
+                 0x50);
+  control_change(&midi_state_machine,
+                 MIDI_state_machine::CONTROLLER_PULSE_WIDTH, 0x20);
+  control_change(&midi_state_machine,
+                 MIDI_state_machine::CONTROLLER_MODULATION, 0x7f);
+  control_change(&midi_state_machine,
+                 MIDI_state_machine::CONTROLLER_LFO_RATE, 0x7f);
+  Synth_renderer renderer(&midi_state_machine);
+  const MIDI_state_machine::osc_bank_t *osc_bank =
+    midi_state_machine.get_osc_bank();
+  const MIDI_state_machine::channel_status_t *channel_status =
+    midi_state_machine.get_channel_status(0);
+  const uint8_t note_on[4] = { 0x09, 0x90, PITCH, 0x7f };
+  const uint8_t note_off[4] = { 0x08, 0x80, PITCH, 0x00 };
+  uint32_t bad_ticks = 0;
+  const auto check_tick = [&]() {
+    if (!midi_state_machine.get_active_osc_count()) {
+      return true; // faded out
+    }
+    const int32_t elongation_left = osc_bank->elongation_left[PITCH];
+    const int32_t elongation_right = osc_bank->elongation_right[PITCH];
+    const uint32_t period =
+      osc_bank->count_wrap[PITCH] + osc_bank->count_wrap_next[PITCH];
+    const uint32_t high =
+      (period * channel_status->duty) >> MIDI_state_machine::DUTY_BITS;
+    const bool negative = (elongation_left | elongation_right) < 0;
+    if (!(elongation_left | elongation_right) ||
+        (negative != (osc_bank->count_wrap[PITCH] != high))) {
+      bad_ticks++;
+    }
+    return false;
+  };
+  midi_state_machine.consume_event_packet(note_on);
+  render_until(&renderer, [&]() {
+    check_tick();
+    return !midi_state_machine.has_ramping_voices();
+  });
+  midi_state_machine.consume_event_packet(note_off);
+  render_until(&renderer, check_tick);
+  const bool ok = !bad_ticks;
+  printf("%-8s %6u ticks with lost sign: %s\n", "polarity", bad_ticks,
+         ok ? "ok" : "FAILED");
+  return ok;
+}
+#endif
+
+/*
+ * The attack value 0x7f takes longer than the benchmark runs, such
+ * that all voices ramp all the time; with attack value 0, all voices
+ * sustain right from the start.
+ */
+static double
+bench_ns_per_frame(const size_t voice_count, const uint8_t attack)
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  control_change(&midi_state_machine, MIDI_state_machine::CONTROLLER_ATTACK,
+                 attack);
+  note_on_spread(&midi_state_machine, voice_count);
+  Synth_renderer renderer(&midi_state_machine);
+  int16_t out[2 * BUFFER_FRAMES];
+  const uint32_t buffer_count = BENCH_SECONDS * SAMPLE_FREQ / BUFFER_FRAMES;
+  volatile int16_t sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t buffer = 0; buffer < buffer_count; buffer++) {
+    renderer.render(out, BUFFER_FRAMES, true);
+    sink = sink + out[buffer % (2 * BUFFER_FRAMES)];
+  }
+  return elapsed_ns(start) / ((double)buffer_count * BUFFER_FRAMES);
+}
+
+int
+main()
+{
+  printf("%u Hz, envelope tick every %u frames\n", SAMPLE_FREQ, TICK_FRAMES);
+  if (!check_stages()) {
+    return EXIT_FAILURE;
+  }
+#ifndef USE_DDS_OSC
+  if (!check_polarity()) {
+    return EXIT_FAILURE;
+  }
+#endif
+  const size_t voice_counts[] = { 1, 8, 32, 128 };
+  printf("%8s %18s %18s %10s\n",
+         "voices", "sustain ns/fr", "ramping ns/fr", "overhead");
+  for (const size_t voice_count : voice_counts) {
+    const double sustain_ns = bench_ns_per_frame(voice_count, 0x00);
+    const double ramping_ns = bench_ns_per_frame(voice_count, 0x7f);
+    printf("%8zu %18.2f %18.2f %9.1f%%\n", voice_count, sustain_ns,
+           ramping_ns, 100.0 * (ramping_ns - sustain_ns) / sustain_ns);
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
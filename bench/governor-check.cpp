@@ -0,0 +1,142 @@
+/*
+ * Governor Check of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+/*
+ * Host check of the render governor's policy under a simulated CPU
+ * cost that grows with the number of active oscillators: overload
+ * must be resolved within a few buffers by stealing the quietest
+ * voices only, and the voice limit must recover once the load is
+ * low again.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include "render-governor.hpp"
+#include "synth-renderer.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint32_t BUFFER_FRAMES = 256;
+static const uint32_t PERIOD_US = BUFFER_FRAMES * 1000000 / SAMPLE_FREQ;
+static const uint32_t BASE_US = 500; // events, mix bus
+static const uint32_t OSC_US = 100; // 128 oscillators overload the core
+
+static uint32_t
+simulated_render_us(MIDI_state_machine *midi_state_machine)
+{
+  return BASE_US + OSC_US * midi_state_machine->get_active_osc_count();
+}
+
+static void
+print_state(const uint32_t buffer, MIDI_state_machine *midi_state_machine,
+            Render_governor *governor)
+{
+  printf("%8u %8u %8zu %8zu %8u\n", buffer, governor->get_load(),
+         midi_state_machine->get_voice_count(),
+         midi_state_machine->get_voice_limit(),
+         midi_state_machine->get_stolen_voice_count());
+}
+
+int
+main()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  Synth_renderer renderer(&midi_state_machine);
+  Render_governor governor(&midi_state_machine);
+  // instant attack, such that all voices are at their velocity
+  const uint8_t attack[4] = {
+    0x0b, 0xb0, MIDI_state_machine::CONTROLLER_ATTACK, 0x00
+  };
+  midi_state_machine.consume_event_packet(attack);
+  // one voice per note, velocities shuffled over the pitch range
+  for (uint32_t note = 0; note < MIDI_state_machine::NUM_OSC; note++) {
+    const uint8_t velocity = 1 + (note * 37) % 0x7f;
+    const uint8_t note_on[4] = { 0x09, 0x90, (uint8_t)note, velocity };
+    midi_state_machine.consume_event_packet(note_on);
+  }
+  printf("%u us per buffer, simulated cost %u us + %u us per oscillator\n",
+         PERIOD_US, BASE_US, OSC_US);
+  printf("%8s %8s %8s %8s %8s\n",
+         "buffer", "load", "voices", "limit", "stolen");
+  int16_t out[2 * BUFFER_FRAMES];
+  uint32_t buffer = 0;
+  uint32_t overloaded_buffers = 0;
+  for (; buffer < 32; buffer++) {
+    renderer.render(out, BUFFER_FRAMES, true);
+    governor.update(simulated_render_us(&midi_state_machine), PERIOD_US);
+    if (governor.get_load() > Render_governor::HIGH_LOAD) {
+      overloaded_buffers++;
+      print_state(buffer, &midi_state_machine, &governor);
+    }
+  }
+  print_state(buffer, &midi_state_machine, &governor);
+  bool ok = governor.get_load() <= Render_governor::HIGH_LOAD;
+
+  // the quietest notes must have gone first
+  uint8_t loudest_stolen = 0;
+  uint8_t quietest_kept = 0x7f;
+  for (uint32_t note = 0; note < MIDI_state_machine::NUM_OSC; note++) {
+    const uint8_t velocity = 1 + (note * 37) % 0x7f;
+    if (midi_state_machine.get_osc_bank()->elongation_left[note]) {
+      quietest_kept = velocity < quietest_kept ? velocity : quietest_kept;
+    } else {
+      loudest_stolen = velocity > loudest_stolen ? velocity : loudest_stolen;
+    }
+  }
+  printf("loudest stolen velocity %u, quietest kept velocity %u\n",
+         loudest_stolen, quietest_kept);
+  ok &= loudest_stolen <= quietest_kept;
+
+  // with all notes released, the limit recovers
+  for (uint32_t note = 0; note < MIDI_state_machine::NUM_OSC; note++) {
+    const uint8_t note_off[4] = { 0x08, 0x80, (uint8_t)note, 0x00 };
+    midi_state_machine.consume_event_packet(note_off);
+  }
+  const uint32_t relax_buffers =
+    Render_governor::RELAX_BUFFERS * MIDI_state_machine::NUM_VOICES;
+  for (uint32_t relaxed = 0; relaxed < relax_buffers; relaxed++, buffer++) {
+    renderer.render(out, BUFFER_FRAMES, true);
+    governor.update(simulated_render_us(&midi_state_machine), PERIOD_US);
+  }
+  print_state(buffer, &midi_state_machine, &governor);
+  ok &= midi_state_machine.get_voice_limit() == MIDI_state_machine::NUM_VOICES;
+  printf("overloaded buffers: %u, peak load %u permille: %s\n",
+         overloaded_buffers, governor.get_peak_load(), ok ? "ok" : "FAILED");
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
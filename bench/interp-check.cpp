@@ -0,0 +1,131 @@
+/*
+ * Interpolator Check of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+
+/*
+ * Host check of the interpolator oscillator path against the plain C
+ * phase accumulator loop: drives the software model of interp0 the
+ * same way as the renderer does with USE_INTERP_OSC, for all pulse
+ * widths the MIDI state machine can select and random phases and
+ * increments, including the edges of the phase range, and verifies
+ * that the sign of every sample and the final phase agree.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "hardware/interp.h"
+#include "midi-state-machine.hpp"
+
+static const uint32_t RUN_FRAMES = 4096;
+static const uint32_t RUNS_PER_WIDTH = 64;
+
+/*
+ * Returns the number of frames in which both paths agree, i.e.
+ * RUN_FRAMES on success.
+ */
+static uint32_t
+compare(const uint32_t start_phase, const uint32_t phase_inc,
+        const uint32_t pulse_width)
+{
+  interp_config phase_config = interp_default_config();
+  interp_set_config(interp0, 0, &phase_config);
+  interp_config sign_config = interp_default_config();
+  interp_config_set_cross_input(&sign_config, true);
+  interp_config_set_shift(&sign_config, 1);
+  interp_config_set_mask(&sign_config, 0, 30);
+  interp_set_config(interp0, 1, &sign_config);
+  interp_set_base(interp0, 0, phase_inc);
+  interp_set_base(interp0, 1, 0x80000000u - (pulse_width >> 1));
+  interp_set_accumulator(interp0, 0, start_phase + phase_inc);
+  uint32_t phase = start_phase;
+  for (uint32_t frame = 0; frame < RUN_FRAMES; frame++) {
+    phase += phase_inc;
+    const int32_t sign = -(int32_t)(phase >= pulse_width);
+    const int32_t interp_sign =
+      (int32_t)interp_pop_lane_result(interp0, 1) >> 31;
+    if (interp_sign != sign) {
+      return frame;
+    }
+  }
+  if (interp_get_accumulator(interp0, 0) - phase_inc != phase) {
+    return RUN_FRAMES - 1;
+  }
+  return RUN_FRAMES;
+}
+
+static bool
+check(std::mt19937 *random, const uint32_t pulse_width)
+{
+  const uint32_t edges[] = {
+    0, 1, pulse_width - 1, pulse_width, pulse_width + 1, 0xffffffffu
+  };
+  for (uint32_t run = 0; run < RUNS_PER_WIDTH; run++) {
+    const uint32_t start_phase =
+      run < sizeof(edges) / sizeof(edges[0]) ? edges[run] : (*random)();
+    // up to a quarter of the phase range, i.e. half the sample rate
+    const uint32_t phase_inc = (run & 1) ? (*random)() >> 2 : run;
+    const uint32_t frames = compare(start_phase, phase_inc, pulse_width);
+    if (frames < RUN_FRAMES) {
+      fprintf(stderr, "mismatch in frame %u for phase 0x%08x, "
+              "increment 0x%08x, pulse width 0x%08x\n",
+              frames, start_phase, phase_inc, pulse_width);
+      return false;
+    }
+  }
+  return true;
+}
+
+int
+main()
+{
+  std::mt19937 random(0x5eed);
+  const uint32_t duty_count = MIDI_state_machine::DUTY_FULL;
+  for (uint32_t duty = 0; duty < duty_count; duty++) {
+    const uint32_t pulse_width =
+      duty << (32 - MIDI_state_machine::DUTY_BITS);
+    if (!check(&random, pulse_width)) {
+      return EXIT_FAILURE;
+    }
+  }
+  printf("interpolator model matches plain C loop for %u pulse widths, "
+         "%u runs of %u frames each\n",
+         duty_count, RUNS_PER_WIDTH, RUN_FRAMES);
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
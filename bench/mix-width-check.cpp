@@ -0,0 +1,185 @@
+/*
+ * Mix Width Check of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+/*
+ * Host check that the 32 bit mix path is exact: with instant
+ * envelopes, such that the elongations stay constant, and notes
+ * played at full velocity on all pitched channels until all voices
+ * are in use, accumulate every frame once more with 64 bit arithmetic, as the
+ * synth used to do, verify that the scaled 64 bit sums never leave
+ * the int32 range, and that the output of the renderer is bit for
+ * bit the same as the 64 bit sums passed through the mix bus.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "mix-bus.hpp"
+#include "synth-renderer.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint32_t BUFFER_FRAMES = 256;
+static const uint32_t CHECK_BUFFERS = 4 * SAMPLE_FREQ / BUFFER_FRAMES;
+
+typedef MIDI_state_machine::osc_status_t osc_status_t;
+
+static void
+note_on_all(MIDI_state_machine *midi_state_machine)
+{
+  for (uint8_t channel = 0; channel < MIDI_state_machine::NUM_CHN;
+       channel++) {
+    if (channel == MIDI_state_machine::PERCUSSION_CHANNEL) {
+      continue; // drums do not play oscillators
+    }
+    const uint8_t envelope[][2] = {
+      { MIDI_state_machine::CONTROLLER_ATTACK, 0x00 },
+      { MIDI_state_machine::CONTROLLER_SUSTAIN, 0x7f },
+      { MIDI_state_machine::CONTROLLER_RELEASE, 0x00 }
+    };
+    for (const auto &control : envelope) {
+      const uint8_t control_change[4] = {
+        0x0b, (uint8_t)(0xb0 | channel), control[0], control[1]
+      };
+      midi_state_machine->consume_event_packet(control_change);
+    }
+    for (uint8_t note = 0; note < MIDI_state_machine::NUM_OSC; note++) {
+      const uint8_t note_on[4] = {
+        0x09, (uint8_t)(0x90 | channel), note, 0x7f
+      };
+      midi_state_machine->consume_event_packet(note_on);
+    }
+  }
+}
+
+/*
+ * Steps all oscillators by one frame, returning the 64 bit sums of
+ * the left and right channel.
+ */
+static void
+step_64(osc_status_t *osc_statuses, int64_t *sum_left, int64_t *sum_right)
+{
+  *sum_left = 0;
+  *sum_right = 0;
+  for (size_t osc = 0; osc < MIDI_state_machine::NUM_OSC; osc++) {
+    osc_status_t *osc_status = &osc_statuses[osc];
+#ifdef USE_DDS_OSC
+    osc_status->phase += osc_status->phase_inc;
+    const int64_t sign =
+      (osc_status->phase >= osc_status->pulse_width) ? -1 : 1;
+    *sum_left += sign * osc_status->elongation_left;
+    *sum_right += sign * osc_status->elongation_right;
+#else
+    osc_status->count += MIDI_state_machine::COUNT_INC;
+    if (osc_status->count >= osc_status->count_wrap) {
+      osc_status->count -= osc_status->count_wrap;
+      const uint32_t count_wrap = osc_status->count_wrap;
+      osc_status->count_wrap = osc_status->count_wrap_next;
+      osc_status->count_wrap_next = count_wrap;
+      osc_status->elongation_left = -osc_status->elongation_left;
+      osc_status->elongation_right = -osc_status->elongation_right;
+    }
+    *sum_left += osc_status->elongation_left;
+    *sum_right += osc_status->elongation_right;
+#endif
+  }
+}
+
+static bool
+fits_int32(const int64_t sum)
+{
+  const int64_t scaled = sum * Mix_bus::VOL_MUL;
+  return (scaled >= INT32_MIN) && (scaled <= INT32_MAX);
+}
+
+static bool
+check(const bool stereo)
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  note_on_all(&midi_state_machine);
+  static osc_status_t osc_statuses[MIDI_state_machine::NUM_OSC];
+  midi_state_machine.get_osc_statuses(osc_statuses);
+  Synth_renderer renderer(&midi_state_machine);
+  Mix_bus mix_bus;
+  int16_t out[2 * BUFFER_FRAMES];
+  int16_t ref_out[2 * BUFFER_FRAMES];
+  int32_t mix_left[BUFFER_FRAMES];
+  int32_t mix_right[BUFFER_FRAMES];
+  int64_t peak = 0;
+  for (uint32_t buffer = 0; buffer < CHECK_BUFFERS; buffer++) {
+    for (uint32_t frame = 0; frame < BUFFER_FRAMES; frame++) {
+      int64_t sum_left, sum_right;
+      step_64(osc_statuses, &sum_left, &sum_right);
+      if (!fits_int32(sum_left) || !fits_int32(sum_right) ||
+          !fits_int32(sum_left + sum_right)) {
+        fprintf(stderr, "64 bit sum exceeds int32 in buffer %u\n", buffer);
+        return false;
+      }
+      if (sum_left > peak || -sum_left > peak) {
+        peak = sum_left > 0 ? sum_left : -sum_left;
+      }
+      if (sum_right > peak || -sum_right > peak) {
+        peak = sum_right > 0 ? sum_right : -sum_right;
+      }
+      mix_left[frame] = sum_left;
+      mix_right[frame] = sum_right;
+    }
+    mix_bus.write_out(mix_left, mix_right, ref_out, BUFFER_FRAMES, stereo);
+    renderer.render(out, BUFFER_FRAMES, stereo);
+    if (memcmp(out, ref_out, BUFFER_FRAMES * (stereo ? 4 : 2))) {
+      fprintf(stderr, "%s output differs from 64 bit path in buffer %u\n",
+              stereo ? "stereo" : "mono", buffer);
+      return false;
+    }
+  }
+  printf("%s: bit-identical over %u frames, peak sum %lld, "
+         "peak scaled sum %lld of %d\n", stereo ? "stereo" : "mono",
+         CHECK_BUFFERS * BUFFER_FRAMES, (long long)peak,
+         (long long)(peak * Mix_bus::VOL_MUL), INT32_MAX);
+  return true;
+}
+
+int
+main()
+{
+  if (!check(false) || !check(true)) {
+    return EXIT_FAILURE;
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
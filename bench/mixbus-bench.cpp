@@ -0,0 +1,154 @@
+/*
+ * Mix Bus Benchmark of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+/*
+ * Host benchmark comparing the saturating mix bus against the former
+ * plain cast of the scaled mix to int16_t, which silently wraps
+ * around on overload.  For growing numbers of full velocity voices,
+ * layered on one or more MIDI channels, reports how many samples
+ * wrapped with the plain cast versus how
+ * many were softly limited or clipped by the mix bus, as well as
+ * the cost per frame of either output stage.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "bench-common.hpp"
+#include "mix-bus.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint32_t BUFFER_FRAMES = 256;
+static const uint32_t BENCH_BUFFERS = 20 * SAMPLE_FREQ / BUFFER_FRAMES;
+static const uint8_t VELOCITY = 0x7f;
+
+/*
+ * Sum of voice_count square waves with periods spread over some
+ * octaves, each played at full velocity on channel_count channels,
+ * as the oscillator stage would produce.
+ */
+static void
+fill_mix(int32_t *mix, const uint32_t buffer, const size_t voice_count,
+         const size_t channel_count)
+{
+  const int32_t elongation = VELOCITY * channel_count;
+  for (uint32_t frame = 0; frame < BUFFER_FRAMES; frame++) {
+    const uint32_t time = buffer * BUFFER_FRAMES + frame;
+    int32_t sample_value = 0;
+    for (size_t voice = 0; voice < voice_count; voice++) {
+      const uint32_t half_period = 8 + 3 * voice;
+      sample_value += ((time / half_period) & 0x1) ? -elongation : elongation;
+    }
+    mix[frame] = sample_value;
+  }
+}
+
+static void
+write_out_cast(const int32_t *mix, int16_t *out, const uint32_t frame_count)
+{
+  for (uint32_t frame = 0; frame < frame_count; frame++) {
+    const int16_t scaled_sample_value =
+      (int16_t)((mix[frame] * Mix_bus::VOL_MUL) >> Mix_bus::VOL_BITS);
+    *out++ = scaled_sample_value; // left channel
+    *out++ = scaled_sample_value; // right channel
+  }
+}
+
+static uint32_t
+count_wrapped(const int32_t *mix, const uint32_t frame_count)
+{
+  uint32_t wrapped_count = 0;
+  for (uint32_t frame = 0; frame < frame_count; frame++) {
+    const int32_t sample_value =
+      (mix[frame] * Mix_bus::VOL_MUL) >> Mix_bus::VOL_BITS;
+    if (sample_value != (int16_t)sample_value) {
+      wrapped_count++;
+    }
+  }
+  return wrapped_count;
+}
+
+int
+main()
+{
+  const size_t voice_counts[] = { 8, 32, 128 };
+  const size_t channel_counts[] = { 1, 4, 16 };
+  static int32_t mix[BENCH_BUFFERS][BUFFER_FRAMES];
+  int16_t out[2 * BUFFER_FRAMES];
+  volatile int16_t sink = 0;
+  printf("%u Hz stereo, %u frames per buffer, velocity %u\n",
+         SAMPLE_FREQ, BUFFER_FRAMES, VELOCITY);
+  printf("%8s %8s %10s %10s %10s %12s %12s\n", "voices", "channels",
+         "wrapped", "limited", "clipped", "cast ns/fr", "bus ns/fr");
+  for (const size_t voice_count : voice_counts) {
+    for (const size_t channel_count : channel_counts) {
+      uint32_t wrapped_count = 0;
+      for (uint32_t buffer = 0; buffer < BENCH_BUFFERS; buffer++) {
+        fill_mix(mix[buffer], buffer, voice_count, channel_count);
+        wrapped_count += count_wrapped(mix[buffer], BUFFER_FRAMES);
+      }
+
+      auto start = std::chrono::steady_clock::now();
+      for (uint32_t buffer = 0; buffer < BENCH_BUFFERS; buffer++) {
+        write_out_cast(mix[buffer], out, BUFFER_FRAMES);
+        sink = sink + out[buffer % (2 * BUFFER_FRAMES)];
+      }
+      const double cast_ns = elapsed_ns(start);
+
+      Mix_bus mix_bus;
+      uint32_t limited_count = 0;
+      start = std::chrono::steady_clock::now();
+      for (uint32_t buffer = 0; buffer < BENCH_BUFFERS; buffer++) {
+        mix_bus.reset_meters();
+        mix_bus.write_out(mix[buffer], mix[buffer], out, BUFFER_FRAMES, true);
+        limited_count += mix_bus.get_meters()->limited_sample_count;
+        sink = sink + out[buffer % (2 * BUFFER_FRAMES)];
+      }
+      const double bus_ns = elapsed_ns(start);
+
+      const double frame_count = (double)BENCH_BUFFERS * BUFFER_FRAMES;
+      printf("%8zu %8zu %10u %10u %10u %12.2f %12.2f\n",
+             voice_count, channel_count,
+             wrapped_count, limited_count,
+             mix_bus.get_total_clipped_sample_count(),
+             cast_ns / frame_count, bus_ns / frame_count);
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
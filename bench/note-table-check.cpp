@@ -0,0 +1,203 @@
+/*
+ * Note Table Check of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+
+/*
+ * Host check of the note table: plays random notes on all pitched
+ * channels, with the hold pedal going up and down and now and then
+ * "all notes off", and verifies after every event that the sounding
+ * notes, the voice count and the velocities of all 16 x 128 keys
+ * match a plain model of the keys and the pedal.  Fewer notes than
+ * voices are used, such that no voice is ever stolen, and releases
+ * are instant, such that a note sounds exactly while its key is down
+ * or held.  Finally reports the cost of a note on and off pair.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include <random>
+#include "bench-common.hpp"
+#include "midi-state-machine.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint32_t EVENTS = 20000;
+static const uint8_t NOTES_PER_CHANNEL = 8;
+static const uint8_t FIRST_PITCH = 0x20;
+static const uint32_t BENCH_RUNS = 100000;
+
+typedef MIDI_state_machine::channel_status_t channel_status_t;
+
+typedef struct {
+  uint8_t velocity[MIDI_state_machine::NUM_OSC]; // 0 while the key is up
+  bool held[MIDI_state_machine::NUM_OSC];
+  bool hold;
+} model_channel_t;
+
+static model_channel_t model[MIDI_state_machine::NUM_CHN];
+
+static void
+model_note_off(model_channel_t *channel, const uint8_t pitch)
+{
+  if (channel->velocity[pitch] && channel->hold) {
+    channel->held[pitch] = true;
+  }
+  channel->velocity[pitch] = 0;
+}
+
+static void
+play_random_event(MIDI_state_machine *midi_state_machine, std::mt19937 *rng)
+{
+  uint8_t channel = (*rng)() % MIDI_state_machine::NUM_CHN;
+  if (channel == MIDI_state_machine::PERCUSSION_CHANNEL) {
+    channel = 0;
+  }
+  model_channel_t *model_channel = &model[channel];
+  const uint8_t pitch = FIRST_PITCH + 11 * ((*rng)() % NOTES_PER_CHANNEL);
+  const uint32_t action = (*rng)() % 100;
+  if (action < 50) {
+    const uint8_t velocity = 1 + (*rng)() % 0x7f;
+    send(midi_state_machine, channel, 0x90, pitch, velocity);
+    model_channel->velocity[pitch] = velocity;
+    model_channel->held[pitch] = false;
+  } else if (action < 90) {
+    send(midi_state_machine, channel, 0x80, pitch);
+    model_note_off(model_channel, pitch);
+  } else if (action < 98) {
+    const bool hold = !model_channel->hold;
+    send(midi_state_machine, channel, 0xb0,
+         MIDI_state_machine::CONTROLLER_HOLD, hold ? 0x7f : 0x00);
+    model_channel->hold = hold;
+    if (!hold) {
+      for (bool &held : model_channel->held) {
+        held = false;
+      }
+    }
+  } else {
+    send(midi_state_machine, channel, 0xb0,
+         MIDI_state_machine::CONTROLLER_ALL_NOTES_OFF, 0x00);
+    for (uint8_t note = 0; note < MIDI_state_machine::NUM_OSC; note++) {
+      model_note_off(model_channel, note);
+    }
+  }
+}
+
+static bool
+matches_model(MIDI_state_machine *midi_state_machine, const uint32_t event)
+{
+  size_t sounding_count = 0;
+  for (uint8_t channel = 0; channel < MIDI_state_machine::NUM_CHN;
+       channel++) {
+    const channel_status_t *channel_status =
+      midi_state_machine->get_channel_status(channel);
+    const model_channel_t *model_channel = &model[channel];
+    for (uint8_t pitch = 0; pitch < MIDI_state_machine::NUM_OSC; pitch++) {
+      const bool sounding =
+        channel_status->sounding_notes[pitch >> 5] & (1u << (pitch & 0x1f));
+      const bool expected_sounding =
+        model_channel->velocity[pitch] || model_channel->held[pitch];
+      const uint8_t velocity =
+        midi_state_machine->get_note_velocity(channel, pitch);
+      if ((sounding != expected_sounding) ||
+          (velocity != model_channel->velocity[pitch])) {
+        fprintf(stderr, "event %u: channel %u, pitch %u sounding %d, "
+                "velocity %u, expected %d, %u\n", event, channel, pitch,
+                sounding, velocity, expected_sounding,
+                model_channel->velocity[pitch]);
+        return false;
+      }
+      sounding_count += sounding;
+    }
+  }
+  if (sounding_count != midi_state_machine->get_voice_count()) {
+    fprintf(stderr, "event %u: %zu sounding notes, but %zu voices\n",
+            event, sounding_count, midi_state_machine->get_voice_count());
+    return false;
+  }
+  return true;
+}
+
+static bool
+check(MIDI_state_machine *midi_state_machine)
+{
+  for (uint8_t channel = 0; channel < MIDI_state_machine::NUM_CHN;
+       channel++) {
+    send(midi_state_machine, channel, 0xb0,
+         MIDI_state_machine::CONTROLLER_RELEASE, 0x00);
+  }
+  std::mt19937 rng(1);
+  size_t peak_voices = 0;
+  for (uint32_t event = 0; event < EVENTS; event++) {
+    play_random_event(midi_state_machine, &rng);
+    if (!matches_model(midi_state_machine, event)) {
+      return false;
+    }
+    const size_t voice_count = midi_state_machine->get_voice_count();
+    peak_voices = voice_count > peak_voices ? voice_count : peak_voices;
+  }
+  printf("%u random events matched the model, peak %zu voices\n",
+         EVENTS, peak_voices);
+  return true;
+}
+
+static void
+bench(MIDI_state_machine *midi_state_machine)
+{
+  midi_state_machine->reset();
+  note_on_spread(midi_state_machine, 48);
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t run = 0; run < BENCH_RUNS; run++) {
+    const uint8_t pitch = 1 + 2 * (run % 48);
+    send(midi_state_machine, 0x1, 0x90, pitch, 0x7f);
+    send(midi_state_machine, 0x1, 0x80, pitch);
+  }
+  printf("note on and off with 48 notes sounding: %.0f ns, "
+         "note state %zu bytes\n", elapsed_ns(start) / BENCH_RUNS,
+         MIDI_state_machine::NOTE_TABLE_SIZE +
+         MIDI_state_machine::NUM_CHN * MIDI_state_machine::NUM_OSC / 8);
+}
+
+int
+main()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  const bool ok = check(&midi_state_machine);
+  bench(&midi_state_machine);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,173 @@
+/*
+ * Oscillator Layout Benchmark of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+/*
+ * Host benchmark of the per-sample oscillator loop over the former
+ * array of osc_status_t records versus the structure-of-arrays
+ * oscillator bank.  Both start from the same state (taken via the
+ * compatibility accessor get_osc_statuses()) and are checked to
+ * produce identical sums before timing.  Besides the time per frame,
+ * reports the bytes per active oscillator and frame that each layout
+ * drags through the memory system: the whole record for the array of
+ * structs, versus only the fields that the loop actually touches for
+ * the oscillator bank.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "bench-common.hpp"
+#include "midi-state-machine.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint32_t BENCH_FRAMES = 20 * SAMPLE_FREQ;
+
+typedef MIDI_state_machine::osc_status_t osc_status_t;
+typedef MIDI_state_machine::osc_bank_t osc_bank_t;
+
+static int64_t
+run_records(osc_status_t *osc_statuses, const uint8_t *active_oscs,
+            const size_t active_osc_count, const uint32_t frame_count)
+{
+  int64_t sum = 0;
+  for (uint32_t frame = 0; frame < frame_count; frame++) {
+    int32_t sample_value = 0;
+    for (size_t active = 0; active < active_osc_count; active++) {
+      osc_status_t *osc_status = &osc_statuses[active_oscs[active]];
+#ifdef USE_DDS_OSC
+      const uint32_t phase = osc_status->phase + osc_status->phase_inc;
+      osc_status->phase = phase;
+      const int32_t elongation = osc_status->elongation_left;
+      sample_value += (phase >> 31) ? -elongation : elongation;
+#else
+      int32_t elongation_left = osc_status->elongation_left;
+      int32_t elongation_right = osc_status->elongation_right;
+      uint32_t count = osc_status->count + MIDI_state_machine::COUNT_INC;
+      if (count >= osc_status->count_wrap) {
+        count -= osc_status->count_wrap;
+        elongation_left = -elongation_left;
+        elongation_right = -elongation_right;
+        osc_status->elongation_left = elongation_left;
+        osc_status->elongation_right = elongation_right;
+      }
+      osc_status->count = count;
+      sample_value += elongation_left;
+#endif
+    }
+    sum += sample_value;
+  }
+  return sum;
+}
+
+static int64_t
+run_bank(osc_bank_t *osc_bank, const uint8_t *active_oscs,
+         const size_t active_osc_count, const uint32_t frame_count)
+{
+  int64_t sum = 0;
+  for (uint32_t frame = 0; frame < frame_count; frame++) {
+    int32_t sample_value = 0;
+    for (size_t active = 0; active < active_osc_count; active++) {
+      const uint8_t osc = active_oscs[active];
+#ifdef USE_DDS_OSC
+      const uint32_t phase = osc_bank->phase[osc] + osc_bank->phase_inc[osc];
+      osc_bank->phase[osc] = phase;
+      const int32_t elongation = osc_bank->elongation_left[osc];
+      sample_value += (phase >> 31) ? -elongation : elongation;
+#else
+      int32_t elongation_left = osc_bank->elongation_left[osc];
+      int32_t elongation_right = osc_bank->elongation_right[osc];
+      uint32_t count = osc_bank->count[osc] + MIDI_state_machine::COUNT_INC;
+      if (count >= osc_bank->count_wrap[osc]) {
+        count -= osc_bank->count_wrap[osc];
+        elongation_left = -elongation_left;
+        elongation_right = -elongation_right;
+        osc_bank->elongation_left[osc] = elongation_left;
+        osc_bank->elongation_right[osc] = elongation_right;
+      }
+      osc_bank->count[osc] = count;
+      sample_value += elongation_left;
+#endif
+    }
+    sum += sample_value;
+  }
+  return sum;
+}
+
+int
+main()
+{
+  const size_t voice_counts[] = { 1, 8, 32, 128 };
+#ifdef USE_DDS_OSC
+  const size_t touched_bytes = 2 * sizeof(uint32_t) + sizeof(int16_t);
+#else
+  const size_t touched_bytes = 2 * sizeof(uint32_t) + 2 * sizeof(int16_t);
+#endif
+  printf("bytes per active oscillator and frame: "
+         "records %zu, bank %zu\n", sizeof(osc_status_t), touched_bytes);
+  printf("%8s %14s %14s %10s\n",
+         "voices", "records ns/fr", "bank ns/fr", "speedup");
+  for (const size_t voice_count : voice_counts) {
+    static MIDI_state_machine midi_state_machine;
+    midi_state_machine.init(SAMPLE_FREQ);
+    note_on_spread(&midi_state_machine, voice_count);
+    static osc_status_t osc_statuses[MIDI_state_machine::NUM_OSC];
+    midi_state_machine.get_osc_statuses(osc_statuses);
+    osc_bank_t *osc_bank = midi_state_machine.get_osc_bank();
+    const uint8_t *active_oscs = midi_state_machine.get_active_oscs();
+    const size_t active_osc_count = midi_state_machine.get_active_osc_count();
+
+    auto start = std::chrono::steady_clock::now();
+    const int64_t records_sum =
+      run_records(osc_statuses, active_oscs, active_osc_count, BENCH_FRAMES);
+    const double records_ns = elapsed_ns(start) / BENCH_FRAMES;
+
+    start = std::chrono::steady_clock::now();
+    const int64_t bank_sum =
+      run_bank(osc_bank, active_oscs, active_osc_count, BENCH_FRAMES);
+    const double bank_ns = elapsed_ns(start) / BENCH_FRAMES;
+
+    if (records_sum != bank_sum) {
+      fprintf(stderr, "output mismatch for %zu voices\n", voice_count);
+      return EXIT_FAILURE;
+    }
+    printf("%8zu %14.2f %14.2f %9.2fx\n",
+           voice_count, records_ns, bank_ns, records_ns / bank_ns);
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,198 @@
+/*
+ * Panic Check of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+
+/*
+ * Host check of all notes off, all sound off and the reset API:
+ * verifies that "all notes off" releases the keys of just its channel
+ * and respects the hold pedal, that "all sound off" cuts off held
+ * notes and drums, and that reset() leaves no voice, oscillator or
+ * sounding note behind.  Finally compares the cost of reset() with a
+ * few notes sounding against the former panic, i.e. a note off for
+ * each of the 16 x 128 notes.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include "bench-common.hpp"
+#include "midi-state-machine.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint8_t NOTES_PER_CHANNEL = 6;
+static const uint32_t RUNS = 1000;
+
+typedef MIDI_state_machine::channel_status_t channel_status_t;
+
+// instant envelopes, such that released notes are gone at once
+static void
+play_chords(MIDI_state_machine *midi_state_machine, const uint8_t channels)
+{
+  for (uint8_t channel = 0; channel < channels; channel++) {
+    if (channel == MIDI_state_machine::PERCUSSION_CHANNEL) {
+      continue;
+    }
+    send(midi_state_machine, channel, 0xb0,
+         MIDI_state_machine::CONTROLLER_ATTACK, 0x00);
+    send(midi_state_machine, channel, 0xb0,
+         MIDI_state_machine::CONTROLLER_RELEASE, 0x00);
+    for (uint8_t note = 0; note < NOTES_PER_CHANNEL; note++) {
+      send(midi_state_machine, channel, 0x90, 0x30 + 4 * note + channel, 0x7f);
+    }
+  }
+}
+
+static uint32_t
+count_notes(const uint32_t *notes)
+{
+  uint32_t count = 0;
+  for (size_t word = 0; word < MIDI_state_machine::NUM_OSC / 32; word++) {
+    count += __builtin_popcount(notes[word]);
+  }
+  return count;
+}
+
+static uint32_t
+count_sounding_notes(MIDI_state_machine *midi_state_machine)
+{
+  uint32_t count = 0;
+  for (uint8_t channel = 0; channel < MIDI_state_machine::NUM_CHN;
+       channel++) {
+    count += count_notes(midi_state_machine->get_channel_status(channel)->
+                         sounding_notes);
+  }
+  return count;
+}
+
+static bool
+check_messages(MIDI_state_machine *midi_state_machine)
+{
+  bool ok = true;
+  play_chords(midi_state_machine, 3);
+  ok &= expect("voices", midi_state_machine->get_voice_count(),
+               3 * NOTES_PER_CHANNEL);
+  ok &= expect("sounding notes", count_sounding_notes(midi_state_machine),
+               3 * NOTES_PER_CHANNEL);
+
+  send(midi_state_machine, 1, 0xb0, MIDI_state_machine::CONTROLLER_HOLD,
+       0x7f);
+  send(midi_state_machine, 0, 0xb0,
+       MIDI_state_machine::CONTROLLER_ALL_NOTES_OFF, 0x00);
+  send(midi_state_machine, 1, 0xb0,
+       MIDI_state_machine::CONTROLLER_ALL_NOTES_OFF, 0x00);
+  ok &= expect("voices after notes off", midi_state_machine->get_voice_count(),
+               2 * NOTES_PER_CHANNEL);
+  const channel_status_t *held_channel_status =
+    midi_state_machine->get_channel_status(1);
+  ok &= expect("held notes", count_notes(held_channel_status->held_notes),
+               NOTES_PER_CHANNEL);
+
+  send(midi_state_machine, MIDI_state_machine::PERCUSSION_CHANNEL, 0x90, 38,
+       0x7f);
+  send(midi_state_machine, 1, 0xb0,
+       MIDI_state_machine::CONTROLLER_ALL_SOUND_OFF, 0x00);
+  send(midi_state_machine, MIDI_state_machine::PERCUSSION_CHANNEL, 0xb0,
+       MIDI_state_machine::CONTROLLER_ALL_SOUND_OFF, 0x00);
+  ok &= expect("voices after sound off", midi_state_machine->get_voice_count(),
+               NOTES_PER_CHANNEL);
+  ok &= expect("held notes after sound off",
+               count_notes(held_channel_status->held_notes), 0);
+  ok &= expect("drums after sound off",
+               midi_state_machine->get_percussion_bank()->get_voice_count(),
+               0);
+
+  play_chords(midi_state_machine, MIDI_state_machine::NUM_CHN);
+  midi_state_machine->reset();
+  ok &= expect("voices after reset", midi_state_machine->get_voice_count(), 0);
+  ok &= expect("oscillators after reset",
+               midi_state_machine->get_active_osc_count(), 0);
+  ok &= expect("sounding notes after reset",
+               count_sounding_notes(midi_state_machine), 0);
+  ok &= expect("hold after reset",
+               held_channel_status->controllers
+               [MIDI_state_machine::CONTROLLER_HOLD], 0);
+  int32_t elongations = 0;
+  const MIDI_state_machine::osc_bank_t *osc_bank =
+    midi_state_machine->get_osc_bank();
+  for (size_t osc = 0; osc < MIDI_state_machine::NUM_OSC; osc++) {
+    elongations |= osc_bank->elongation_left[osc] |
+      osc_bank->elongation_right[osc];
+  }
+  ok &= expect("elongations after reset", elongations, 0);
+  return ok;
+}
+
+static void
+note_off_all(MIDI_state_machine *midi_state_machine)
+{
+  for (uint8_t note = 0; note < MIDI_state_machine::NUM_OSC; note++) {
+    for (uint8_t channel = 0; channel < MIDI_state_machine::NUM_CHN;
+         channel++) {
+      send(midi_state_machine, channel, 0x80, note);
+    }
+  }
+}
+
+static void
+bench(MIDI_state_machine *midi_state_machine)
+{
+  double note_off_all_ns = 0.0;
+  double reset_ns = 0.0;
+  for (uint32_t run = 0; run < RUNS; run++) {
+    play_chords(midi_state_machine, 2);
+    auto start = std::chrono::steady_clock::now();
+    note_off_all(midi_state_machine);
+    note_off_all_ns += elapsed_ns(start);
+    play_chords(midi_state_machine, 2);
+    start = std::chrono::steady_clock::now();
+    midi_state_machine->reset();
+    reset_ns += elapsed_ns(start);
+  }
+  printf("with %u notes on: 2048 note offs %.0f ns, reset() %.0f ns\n",
+         2 * NOTES_PER_CHANNEL, note_off_all_ns / RUNS, reset_ns / RUNS);
+}
+
+int
+main()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  const bool ok = check_messages(&midi_state_machine);
+  bench(&midi_state_machine);
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,169 @@
+/*
+ * Percussion Check of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+
+/*
+ * Host check of the percussion bank: verifies that notes on the GM
+ * percussion channel play noise voices rather than oscillators, that
+ * a drum dies away within its decay time, that the hi-hats choke each
+ * other and that the bank never exceeds its voices, and reports the
+ * cost of a full drum bank on top of the pitched voices.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "bench-common.hpp"
+#include "synth-renderer.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint32_t BUFFER_FRAMES = 256;
+static const uint32_t BENCH_SECONDS = 5;
+static const uint32_t TICK_FRAMES = Percussion_bank::TICK_FRAMES;
+static const uint8_t PERCUSSION_CHANNEL =
+  MIDI_state_machine::PERCUSSION_CHANNEL;
+static const uint8_t BASS_DRUM = 36; // decays within 120ms
+static const uint32_t BASS_DRUM_FRAMES = 120 * SAMPLE_FREQ / 1000;
+
+static bool
+check_voices()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  Percussion_bank *percussion_bank =
+    midi_state_machine.get_percussion_bank();
+  bool ok = true;
+  send(&midi_state_machine, PERCUSSION_CHANNEL, 0x90, BASS_DRUM, 0x7f);
+  ok &= expect("oscillators", midi_state_machine.get_active_osc_count(), 0);
+  ok &= expect("drum voices", percussion_bank->get_voice_count(), 1);
+  send(&midi_state_machine, PERCUSSION_CHANNEL, 0x90,
+       Percussion_bank::FIRST_NOTE - 1, 0x7f);
+  send(&midi_state_machine, PERCUSSION_CHANNEL, 0x90,
+       Percussion_bank::LAST_NOTE + 1, 0x7f);
+  ok &= expect("unmapped notes", percussion_bank->get_voice_count(), 1);
+  send(&midi_state_machine, PERCUSSION_CHANNEL, 0x90, 42, 0x7f); // closed
+  send(&midi_state_machine, PERCUSSION_CHANNEL, 0x90, 46, 0x7f); // open
+  ok &= expect("choked hi-hats", percussion_bank->get_voice_count(), 2);
+  for (uint8_t note = 49; note < 49 + Percussion_bank::NUM_VOICES; note++) {
+    send(&midi_state_machine, PERCUSSION_CHANNEL, 0x90, note, 0x7f);
+  }
+  ok &= expect("full bank", percussion_bank->get_voice_count(),
+               Percussion_bank::NUM_VOICES);
+  return ok;
+}
+
+/*
+ * The noise must swing to both sides, and the voice must be freed
+ * within one tick of its decay time.
+ */
+static bool
+check_decay()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  Synth_renderer renderer(&midi_state_machine);
+  send(&midi_state_machine, PERCUSSION_CHANNEL, 0x90, BASS_DRUM, 0x7f);
+  int16_t out[2 * TICK_FRAMES];
+  uint32_t frames = 0;
+  bool positive = false;
+  bool negative = false;
+  while (midi_state_machine.get_percussion_bank()->get_voice_count() &&
+         (frames < SAMPLE_FREQ)) {
+    renderer.render(out, TICK_FRAMES, true);
+    for (uint32_t sample = 0; sample < 2 * TICK_FRAMES; sample++) {
+      positive |= out[sample] > 0;
+      negative |= out[sample] < 0;
+    }
+    frames += TICK_FRAMES;
+  }
+  const bool ok =
+    positive && negative &&
+    (frames + TICK_FRAMES >= BASS_DRUM_FRAMES) &&
+    (frames <= BASS_DRUM_FRAMES + TICK_FRAMES);
+  printf("%-28s %6u frames, expected %6u +/- %u, %s swing: %s\n",
+         "bass drum decay", frames, BASS_DRUM_FRAMES, TICK_FRAMES,
+         positive && negative ? "two-sided" : "one-sided",
+         ok ? "ok" : "FAILED");
+  return ok;
+}
+
+/*
+ * Cymbals take longer than a buffer to decay, and are retriggered
+ * on every buffer to keep all drum voices sounding.
+ */
+static double
+bench_ns_per_frame(const size_t voice_count, const size_t drum_count)
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  note_on_spread(&midi_state_machine, voice_count);
+  Synth_renderer renderer(&midi_state_machine);
+  int16_t out[2 * BUFFER_FRAMES];
+  const uint32_t buffer_count = BENCH_SECONDS * SAMPLE_FREQ / BUFFER_FRAMES;
+  volatile int16_t sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t buffer = 0; buffer < buffer_count; buffer++) {
+    for (size_t drum = 0; drum < drum_count; drum++) {
+      send(&midi_state_machine, PERCUSSION_CHANNEL, 0x90, 49 + drum, 0x7f);
+    }
+    renderer.render(out, BUFFER_FRAMES, true);
+    sink = sink + out[buffer % (2 * BUFFER_FRAMES)];
+  }
+  return elapsed_ns(start) / ((double)buffer_count * BUFFER_FRAMES);
+}
+
+int
+main()
+{
+  printf("%u Hz, %zu drum voices\n", SAMPLE_FREQ, Percussion_bank::NUM_VOICES);
+  if (!check_voices() || !check_decay()) {
+    return EXIT_FAILURE;
+  }
+  const size_t voice_counts[] = { 0, 8, 32, 128 };
+  printf("%8s %18s %18s %12s\n",
+         "voices", "no drums ns/fr", "all drums ns/fr", "drums ns/fr");
+  for (const size_t voice_count : voice_counts) {
+    const double pitched_ns = bench_ns_per_frame(voice_count, 0);
+    const double drums_ns =
+      bench_ns_per_frame(voice_count, Percussion_bank::NUM_VOICES);
+    printf("%8zu %18.2f %18.2f %12.2f\n", voice_count, pitched_ns,
+           drums_ns, drums_ns - pitched_ns);
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
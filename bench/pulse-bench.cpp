@@ -0,0 +1,191 @@
+/*
+ * Pulse Width Benchmark of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+/*
+ * Host benchmark of pulse width modulation: checks the duty cycle of
+ * a single note and that the span renderer still matches the
+ * per-sample reference with modulated pulse widths, then compares
+ * the rendering cost of square waves against fixed and LFO modulated
+ * pulse widths.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "bench-common.hpp"
+#include "synth-renderer.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint32_t BUFFER_FRAMES = 256;
+static const uint32_t BENCH_SECONDS = 20;
+
+static void
+control_change(MIDI_state_machine *midi_state_machine,
+               const uint8_t controller, const uint8_t value)
+{
+  const uint8_t packet[4] = { 0x0b, 0xb0, controller, value };
+  midi_state_machine->consume_event_packet(packet);
+}
+
+static void
+set_pulse_width(MIDI_state_machine *midi_state_machine,
+                const uint8_t pulse_width, const uint8_t lfo_depth)
+{
+  control_change(midi_state_machine,
+                 MIDI_state_machine::CONTROLLER_PULSE_WIDTH, pulse_width);
+  control_change(midi_state_machine,
+                 MIDI_state_machine::CONTROLLER_MODULATION, lfo_depth);
+  control_change(midi_state_machine,
+                 MIDI_state_machine::CONTROLLER_LFO_RATE, 0x7f);
+}
+
+/*
+ * Count the positive samples of a single low note over a whole
+ * number of periods (A1 = 55Hz, i.e. 11 periods in 0.2s).
+ */
+static bool
+check_duty(const uint8_t pulse_width)
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  set_pulse_width(&midi_state_machine, pulse_width, 0);
+  control_change(&midi_state_machine, MIDI_state_machine::CONTROLLER_ATTACK,
+                 0x00);
+  const uint8_t note_on[4] = { 0x09, 0x90, 0x21, 0x7f };
+  midi_state_machine.consume_event_packet(note_on);
+  Synth_renderer renderer(&midi_state_machine);
+  const uint32_t frame_count = SAMPLE_FREQ / 5;
+  int16_t out[2 * BUFFER_FRAMES];
+  uint32_t positive_count = 0;
+  for (uint32_t frame = 0; frame < frame_count; frame += BUFFER_FRAMES) {
+    const uint32_t frames =
+      frame_count - frame < BUFFER_FRAMES ? frame_count - frame : BUFFER_FRAMES;
+    renderer.render(out, frames, true);
+    for (uint32_t index = 0; index < frames; index++) {
+      positive_count += out[2 * index] > 0;
+    }
+  }
+  const uint32_t expected_duty =
+    2 * pulse_width < MIDI_state_machine::DUTY_MIN ?
+    MIDI_state_machine::DUTY_MIN :
+    2 * pulse_width > MIDI_state_machine::DUTY_MAX ?
+    MIDI_state_machine::DUTY_MAX : 2 * pulse_width;
+  const double duty = (double)positive_count / frame_count;
+  const double expected = (double)expected_duty / MIDI_state_machine::DUTY_FULL;
+  const bool ok = (duty - expected < 0.005) && (expected - duty < 0.005);
+  printf("pulse width 0x%02x: duty %5.1f%%, expected %5.1f%%: %s\n",
+         pulse_width, 100.0 * duty, 100.0 * expected, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+static bool
+verify(const size_t voice_count)
+{
+  static MIDI_state_machine ref_state_machine;
+  static MIDI_state_machine span_state_machine;
+  ref_state_machine.init(SAMPLE_FREQ);
+  span_state_machine.init(SAMPLE_FREQ);
+  set_pulse_width(&ref_state_machine, 0x20, 0x7f);
+  set_pulse_width(&span_state_machine, 0x20, 0x7f);
+  note_on_spread(&ref_state_machine, voice_count);
+  note_on_spread(&span_state_machine, voice_count);
+  Synth_renderer ref_renderer(&ref_state_machine);
+  Synth_renderer span_renderer(&span_state_machine);
+  int16_t ref_out[2 * BUFFER_FRAMES];
+  int16_t span_out[2 * BUFFER_FRAMES];
+  const uint32_t buffer_count = 2 * SAMPLE_FREQ / BUFFER_FRAMES;
+  for (uint32_t buffer = 0; buffer < buffer_count; buffer++) {
+    ref_renderer.render_per_sample(ref_out, BUFFER_FRAMES, true);
+    span_renderer.render(span_out, BUFFER_FRAMES, true);
+    if (memcmp(ref_out, span_out, sizeof(ref_out))) {
+      fprintf(stderr, "output mismatch for %zu voices in buffer %u\n",
+              voice_count, buffer);
+      return false;
+    }
+  }
+  return true;
+}
+
+static double
+bench_ns_per_frame(const size_t voice_count, const uint8_t pulse_width,
+                   const uint8_t lfo_depth)
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  set_pulse_width(&midi_state_machine, pulse_width, lfo_depth);
+  note_on_spread(&midi_state_machine, voice_count);
+  Synth_renderer renderer(&midi_state_machine);
+  int16_t out[2 * BUFFER_FRAMES];
+  const uint32_t buffer_count = BENCH_SECONDS * SAMPLE_FREQ / BUFFER_FRAMES;
+  volatile int16_t sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t buffer = 0; buffer < buffer_count; buffer++) {
+    renderer.render(out, BUFFER_FRAMES, true);
+    sink = sink + out[buffer % (2 * BUFFER_FRAMES)];
+  }
+  return elapsed_ns(start) / ((double)buffer_count * BUFFER_FRAMES);
+}
+
+int
+main()
+{
+  const uint8_t pulse_widths[] = { 0x00, 0x10, 0x40, 0x60, 0x7f };
+  for (const uint8_t pulse_width : pulse_widths) {
+    if (!check_duty(pulse_width)) {
+      return EXIT_FAILURE;
+    }
+  }
+  const size_t voice_counts[] = { 1, 8, 32, 128 };
+  printf("%u Hz stereo, %u frames per buffer, %u s of audio per run\n",
+         SAMPLE_FREQ, BUFFER_FRAMES, BENCH_SECONDS);
+  printf("%8s %14s %14s %14s\n",
+         "voices", "square ns/fr", "pulse ns/fr", "pwm lfo ns/fr");
+  for (const size_t voice_count : voice_counts) {
+    if (!verify(voice_count)) {
+      return EXIT_FAILURE;
+    }
+    const double square_ns = bench_ns_per_frame(voice_count, 0x40, 0x00);
+    const double pulse_ns = bench_ns_per_frame(voice_count, 0x20, 0x00);
+    const double lfo_ns = bench_ns_per_frame(voice_count, 0x20, 0x7f);
+    printf("%8zu %14.2f %14.2f %14.2f\n",
+           voice_count, square_ns, pulse_ns, lfo_ns);
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
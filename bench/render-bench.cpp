@@ -0,0 +1,164 @@
+/*
+ * Render Benchmark of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+/*
+ * Host benchmark comparing the span based square wave renderer
+ * against the per-sample reference loop.  Both renderers start from
+ * identical oscillator states, and their output is compared sample
+ * by sample before any timing is reported.
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include "bench-common.hpp"
+#include "synth-renderer.hpp"
+
+static const uint32_t SAMPLE_FREQ = 24000; // [Hz]
+static const uint32_t BUFFER_FRAMES = 256;
+static const uint32_t BENCH_SECONDS = 20;
+
+typedef void (Synth_renderer::*render_func_t)
+  (int16_t *, const uint32_t, const bool);
+
+static double
+bench_ns_per_frame(render_func_t render, const size_t voice_count)
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  note_on_spread(&midi_state_machine, voice_count);
+  Synth_renderer renderer(&midi_state_machine);
+  int16_t out[2 * BUFFER_FRAMES];
+  const uint32_t buffer_count = BENCH_SECONDS * SAMPLE_FREQ / BUFFER_FRAMES;
+  volatile int16_t sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t buffer = 0; buffer < buffer_count; buffer++) {
+    (renderer.*render)(out, BUFFER_FRAMES, true);
+    sink = sink + out[buffer % (2 * BUFFER_FRAMES)];
+  }
+  return elapsed_ns(start) / ((double)buffer_count * BUFFER_FRAMES);
+}
+
+static bool
+verify(const size_t voice_count)
+{
+  static MIDI_state_machine ref_state_machine;
+  static MIDI_state_machine span_state_machine;
+  ref_state_machine.init(SAMPLE_FREQ);
+  span_state_machine.init(SAMPLE_FREQ);
+  // pan off center, such that left and right differ
+  const uint8_t pan[4] = { 0x0b, 0xb0, 0x0a, 0x20 };
+  ref_state_machine.consume_event_packet(pan);
+  span_state_machine.consume_event_packet(pan);
+  note_on_spread(&ref_state_machine, voice_count);
+  note_on_spread(&span_state_machine, voice_count);
+  Synth_renderer ref_renderer(&ref_state_machine);
+  Synth_renderer span_renderer(&span_state_machine);
+  int16_t ref_out[2 * BUFFER_FRAMES];
+  int16_t span_out[2 * BUFFER_FRAMES];
+  const uint32_t buffer_count = 2 * SAMPLE_FREQ / BUFFER_FRAMES;
+  for (uint32_t buffer = 0; buffer < buffer_count; buffer++) {
+    ref_renderer.render_per_sample(ref_out, BUFFER_FRAMES, true);
+    span_renderer.render(span_out, BUFFER_FRAMES, true);
+    if (memcmp(ref_out, span_out, sizeof(ref_out))) {
+      fprintf(stderr, "output mismatch for %zu voices in buffer %u\n",
+              voice_count, buffer);
+      return false;
+    }
+  }
+  return true;
+}
+
+/*
+ * A note posted for some sample time in the middle of a buffer must
+ * start sounding on exactly that sample.
+ */
+static bool
+verify_scheduling()
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(SAMPLE_FREQ);
+  midi_state_machine.enable_event_queue();
+  Synth_renderer renderer(&midi_state_machine);
+  const uint64_t note_sample_time = 3 * BUFFER_FRAMES / 2 + 17;
+  const uint8_t note_on[4] = { 0x09, 0x90, 0x45, 0x7f };
+  midi_state_machine.post_event_packet(note_on, note_sample_time);
+  int16_t out[2 * BUFFER_FRAMES];
+  for (uint32_t buffer = 0; buffer < 2; buffer++) {
+    renderer.render(out, BUFFER_FRAMES, true);
+    for (uint32_t frame = 0; frame < BUFFER_FRAMES; frame++) {
+      const uint64_t sample_time = buffer * BUFFER_FRAMES + frame;
+      if (!out[2 * frame] != (sample_time < note_sample_time)) {
+        fprintf(stderr, "note scheduled for sample %llu, "
+                "but sample %llu is %s\n",
+                (unsigned long long)note_sample_time,
+                (unsigned long long)sample_time,
+                out[2 * frame] ? "non-zero" : "zero");
+        return false;
+      }
+    }
+  }
+  return true;
+}
+
+int
+main()
+{
+  if (!verify_scheduling()) {
+    return EXIT_FAILURE;
+  }
+  const size_t voice_counts[] = { 1, 8, 32, 128 };
+  printf("%u Hz stereo, %u frames per buffer, %u s of audio per run\n",
+         SAMPLE_FREQ, BUFFER_FRAMES, BENCH_SECONDS);
+  printf("%8s %18s %18s %10s\n",
+         "voices", "per-sample ns/fr", "spans ns/fr", "speedup");
+  for (const size_t voice_count : voice_counts) {
+    if (!verify(voice_count)) {
+      return EXIT_FAILURE;
+    }
+    const double per_sample_ns =
+      bench_ns_per_frame(&Synth_renderer::render_per_sample, voice_count);
+    const double spans_ns =
+      bench_ns_per_frame(&Synth_renderer::render, voice_count);
+    printf("%8zu %18.2f %18.2f %9.2fx\n",
+           voice_count, per_sample_ns, spans_ns, per_sample_ns / spans_ns);
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,104 @@
+/*
+ * Sample Clock Check of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+
+/*
+ * Host check of the sample clock: for the frame rates the I2S output
+ * actually runs at with a 125MHz system clock (the PIO divider being
+ * truncated to 24.8 fixed point), converts time stamps up to ten
+ * hours after the anchor and verifies that they stay within one
+ * sample of the exact fraction, and reports how far a conversion at
+ * the nominal sample rate would have drifted.
+ */
+
+#include <cstdio>
+#include <cstdlib>
+#include "sample-clock.hpp"
+
+static const uint32_t SYSTEM_CLOCK_FREQ = 125000000; // [Hz]
+static const uint32_t SAMPLE_FREQS[] = { 22050, 24000, 44100, 48000 };
+static const uint64_t ANCHOR_TIME_US = 1234567;
+static const uint64_t ANCHOR_SAMPLE_TIME = 987654321;
+static const uint64_t CHECK_US = 10ull * 3600 * 1000000;
+static const uint64_t STEP_US = 999983; // prime, to hit odd fractions
+
+static bool
+check(const uint32_t sample_freq)
+{
+  const uint32_t frame_freq_num = SYSTEM_CLOCK_FREQ * 4;
+  const uint32_t frame_freq_den = frame_freq_num / sample_freq;
+  Sample_clock sample_clock;
+  sample_clock.set_anchor(ANCHOR_TIME_US, ANCHOR_SAMPLE_TIME,
+                          Sample_clock::get_frames_per_us(frame_freq_num,
+                                                          frame_freq_den));
+  double max_error = 0.0;
+  for (uint64_t delta_us = 0; delta_us <= CHECK_US; delta_us += STEP_US) {
+    const double exact = (double)delta_us * frame_freq_num /
+      ((double)frame_freq_den * 1000000);
+    const double error =
+      (double)(sample_clock.to_sample_time(ANCHOR_TIME_US + delta_us) -
+               ANCHOR_SAMPLE_TIME) - exact;
+    max_error = error > max_error ? error : -error > max_error ?
+      -error : max_error;
+  }
+  const double ppm = 1e6 * ((double)frame_freq_num /
+                            ((double)frame_freq_den * sample_freq) - 1.0);
+  const bool ok = max_error <= 1.0;
+  printf("%5u Hz: actual rate %+6.1f ppm (%4.0f ms per hour at the "
+         "nominal rate), max error over 10 h %.2f samples: %s\n",
+         sample_freq, ppm, ppm * 3.6, max_error, ok ? "ok" : "FAILED");
+  return ok;
+}
+
+int
+main()
+{
+  bool ok = true;
+  for (const uint32_t sample_freq : SAMPLE_FREQS) {
+    ok &= check(sample_freq);
+  }
+  Sample_clock sample_clock;
+  ok &= sample_clock.to_sample_time(ANCHOR_TIME_US) == 0;
+  sample_clock.set_anchor(ANCHOR_TIME_US, ANCHOR_SAMPLE_TIME,
+                          Sample_clock::get_frames_per_us(24000));
+  ok &= sample_clock.to_sample_time(ANCHOR_TIME_US - 1) == 0;
+  ok &= sample_clock.to_sample_time(ANCHOR_TIME_US + 1000000) ==
+    ANCHOR_SAMPLE_TIME + 24000;
+  return ok ? EXIT_SUCCESS : EXIT_FAILURE;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,103 @@
+/*
+ * Throughput Benchmark of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+/*
+ * Host throughput benchmark of the synth core: renders a fixed amount
+ * of audio for each combination of voice count, sample rate and
+ * channel count, and reports samples per second, nanoseconds per
+ * sample and the share of real time the rendering took.
+ *
+ * Usage: synth-bench [seconds of audio per run, default 10]
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include "bench-common.hpp"
+#include "osc-tables.hpp"
+#include "synth-renderer.hpp"
+
+static const uint32_t BUFFER_FRAMES = 256;
+
+static void
+bench(const uint32_t sample_freq, const bool stereo,
+      const size_t voice_count, const uint32_t seconds)
+{
+  static MIDI_state_machine midi_state_machine;
+  midi_state_machine.init(sample_freq);
+  note_on_spread(&midi_state_machine, voice_count);
+  Synth_renderer renderer(&midi_state_machine);
+  int16_t out[2 * BUFFER_FRAMES];
+  const uint32_t channel_count = stereo ? 2 : 1;
+  const uint32_t buffer_count = seconds * sample_freq / BUFFER_FRAMES;
+  volatile int16_t sink = 0;
+  const auto start = std::chrono::steady_clock::now();
+  for (uint32_t buffer = 0; buffer < buffer_count; buffer++) {
+    renderer.render(out, BUFFER_FRAMES, stereo);
+    sink = sink + out[buffer % (channel_count * BUFFER_FRAMES)];
+  }
+  const double ns = elapsed_ns(start);
+  const double samples = (double)buffer_count * BUFFER_FRAMES * channel_count;
+  const double audio_ns = (double)buffer_count * BUFFER_FRAMES * 1e9 /
+    sample_freq;
+  printf("%8u %7s %7zu %14.3f %12.2f %10.3f%%\n",
+         sample_freq, stereo ? "stereo" : "mono", voice_count,
+         samples * 1e3 / ns, ns / samples, 100.0 * ns / audio_ns);
+}
+
+int
+main(int argc, char *argv[])
+{
+  const uint32_t seconds = argc > 1 ? atoi(argv[1]) : 10;
+  if (!seconds) {
+    fprintf(stderr, "usage: %s [seconds of audio per run]\n", argv[0]);
+    return EXIT_FAILURE;
+  }
+  const size_t voice_counts[] = { 1, 4, 8, 16, 32, 64, 128 };
+  printf("%8s %7s %7s %14s %12s %11s\n",
+         "rate", "format", "voices", "Msamples/s", "ns/sample", "real time");
+  for (const uint32_t sample_freq : Osc_tables::SAMPLE_FREQS) {
+    for (const bool stereo : { false, true }) {
+      for (const size_t voice_count : voice_counts) {
+        bench(sample_freq, stereo, voice_count, seconds);
+      }
+    }
+  }
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -67,16 +67,127 @@ Audio_target::get_sample_freq() const
   return _target_audio_format.sample_freq;
 }
 
+/*
+ * Take back every buffer of the producer pool, blocking until the
+ * consumer has released all of them, and return them to the pool's
+ * free list without queueing them for output.
+ */
+void
+Audio_target::drain_producer_pool()
+{
+  // buffers taken are not on any list, so chain them via their next field
+  audio_buffer_t *drained = 0;
+  for (uint16_t index = 0; index < _buffer_count; index++) {
+    audio_buffer_t *audio_buffer =
+      ::take_audio_buffer(_target_producer_pool, true);
+    audio_buffer->next = drained;
+    drained = audio_buffer;
+  }
+  while (drained) {
+    audio_buffer_t *audio_buffer = drained;
+    drained = drained->next;
+    queue_free_audio_buffer(_target_producer_pool, audio_buffer);
+  }
+  _in_underrun = true;
+  _priming = true;
+}
+
+/*
+ * Switch the sample rate at run time.  The audio format is shared
+ * with the producer pool; the pico-extras I2S consumer compares it
+ * with its current rate whenever it takes the next buffer, and then
+ * reprograms the PIO clock divider accordingly.
+ */
+void
+Audio_target::set_sample_freq(const uint32_t sample_freq)
+{
+  drain_producer_pool();
+  _target_audio_format.sample_freq = sample_freq;
+}
+
 bool
 Audio_target::is_stereo() const
 {
   return _target_audio_format.channel_count == 2;
 }
 
+/*
+ * The rate at which the output actually consumes frames, as a
+ * fraction; targets whose clock divider cannot hit the nominal
+ * sample rate exactly override this.
+ */
+void
+Audio_target::get_frame_freq(uint32_t *const frame_freq_num,
+                             uint32_t *const frame_freq_den) const
+{
+  *frame_freq_num = _target_audio_format.sample_freq;
+  *frame_freq_den = 1;
+}
+
+/*
+ * When the producer pool has run dry, the output is still playing
+ * one last buffer (or a buffer of silence) up to some unknown point;
+ * estimate half of it to remain.
+ */
+uint32_t
+Audio_target::get_in_flight_frames() const
+{
+  return _buffer_sample_count / 2;
+}
+
+/*
+ * The longest time from rendering a buffer into the pool up to its
+ * last frame being played, i.e. when all buffers are queued.
+ */
+uint32_t
+Audio_target::get_latency_us() const
+{
+  uint32_t frame_freq_num, frame_freq_den;
+  get_frame_freq(&frame_freq_num, &frame_freq_den);
+  return (uint64_t)_buffer_count * _buffer_sample_count * 1000000 *
+    frame_freq_den / frame_freq_num;
+}
+
+/*
+ * Returns true if the target itself anchors the sample clock each
+ * time a buffer starts playing, in which case the producer must tag
+ * each buffer with the sample time of its first frame in user_data.
+ * By default, the producer anchors the clock.
+ */
+bool
+Audio_target::set_sample_clock(__unused Sample_clock *const sample_clock)
+{
+  return false;
+}
+
+/*
+ * Underruns are detected from the producer side: whenever a free
+ * buffer is taken while no prepared buffer is left queued for the
+ * consumer, the output has run (or is about to run) dry.  The output
+ * has recovered as soon as the pool has no free buffer left, i.e. all
+ * buffers are queued again.  Priming the pool, initially and after
+ * draining it, is not counted.
+ */
 struct audio_buffer *
 Audio_target::take_audio_buffer(const bool block)
 {
-  return ::take_audio_buffer(_target_producer_pool, block);
+  const bool starved = !_target_producer_pool->prepared_list;
+  struct audio_buffer *audio_buffer =
+    ::take_audio_buffer(_target_producer_pool, block);
+  if (audio_buffer) {
+    if (starved && !_in_underrun) {
+      _in_underrun = true;
+      _underrun_count = _underrun_count + 1;
+    }
+  } else if (_in_underrun) {
+    _in_underrun = false;
+    if (_priming) {
+      _priming = false;
+    } else {
+      _recovery_count = _recovery_count + 1;
+    }
+  }
+  return audio_buffer;
 }
 
 void
@@ -85,6 +196,18 @@ Audio_target::give_audio_buffer(audio_buffer_t *audio_buffer)
   ::give_audio_buffer(_target_producer_pool, audio_buffer);
 }
 
+uint32_t
+Audio_target::get_underrun_count() const
+{
+  return _underrun_count;
+}
+
+uint32_t
+Audio_target::get_recovery_count() const
+{
+  return _recovery_count;
+}
+
 /*
  * Local variables:
  *   mode: c++
@@ -35,18 +35,27 @@
 
 #include <inttypes.h>
 #include "pico/audio.h"
+#include "sample-clock.hpp"
 
 class Audio_target {
 public:
+  static const uint16_t DEFAULT_BUFFER_COUNT;
+  static const uint16_t DEFAULT_BUFFER_SAMPLE_COUNT;
   Audio_target(const uint32_t sample_freq, const bool stereo);
   virtual ~Audio_target();
   uint32_t get_sample_freq() const;
+  virtual void set_sample_freq(const uint32_t sample_freq);
   bool is_stereo() const;
+  virtual void get_frame_freq(uint32_t *const frame_freq_num,
+                              uint32_t *const frame_freq_den) const;
+  virtual uint32_t get_in_flight_frames() const;
+  uint32_t get_latency_us() const;
+  virtual bool set_sample_clock(Sample_clock *const sample_clock);
   struct audio_buffer *take_audio_buffer(const bool block);
   void give_audio_buffer(audio_buffer_t *audio_buffer);
+  uint32_t get_underrun_count() const;
+  uint32_t get_recovery_count() const;
 protected:
-  static const uint16_t DEFAULT_BUFFER_COUNT;
-  static const uint16_t DEFAULT_BUFFER_SAMPLE_COUNT;
   struct audio_format _target_audio_format = {
     .sample_freq = 0,
     .format = AUDIO_BUFFER_FORMAT_PCM_S16,
@@ -57,6 +66,13 @@ protected:
     .sample_stride = 0,
   };
   struct audio_buffer_pool *_target_producer_pool;
+  uint16_t _buffer_count = 0;
+  uint16_t _buffer_sample_count = 0;
+  volatile uint32_t _underrun_count = 0;
+  volatile uint32_t _recovery_count = 0;
+  bool _in_underrun = true;
+  bool _priming = true;
+  void drain_producer_pool();
 };
 
 #endif /* AUDIO_TARGET_HPP */
@@ -0,0 +1,101 @@
+/*
+ * Compile-Time Math Helpers of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#ifndef CONST_MATH_HPP
+#define CONST_MATH_HPP
+
+#include <cstdint>
+
+/*
+ * Minimal math functions that the compiler can evaluate, such that
+ * lookup tables can be generated at compile time and placed in flash
+ * rather than computed with soft-float libm routines at boot.
+ */
+
+static constexpr double CONST_LN_2 = 0.693147180559945309417;
+
+/*
+ * 2^x: split x into integer and fractional part, and sum up the
+ * Taylor series of exp() for the fractional part, which converges to
+ * double precision within a few dozen terms.
+ */
+static constexpr double
+const_exp2(const double x)
+{
+  int n = (int)x;
+  if (n > x) {
+    n--;
+  }
+  const double f = (x - n) * CONST_LN_2;
+  double term = 1.0;
+  double sum = 1.0;
+  for (int k = 1; k < 24; k++) {
+    term *= f / k;
+    sum += term;
+  }
+  for (; n > 0; n--) {
+    sum *= 2.0;
+  }
+  for (; n < 0; n++) {
+    sum *= 0.5;
+  }
+  return sum;
+}
+
+static constexpr double
+const_exp(const double x)
+{
+  return const_exp2(x / CONST_LN_2);
+}
+
+static constexpr double
+const_tanh(const double x)
+{
+  const double e = const_exp(2.0 * x);
+  return (e - 1.0) / (e + 1.0);
+}
+
+// round half up; only valid for non-negative values
+static constexpr uint32_t
+const_round(const double x)
+{
+  return (uint32_t)(x + 0.5);
+}
+
+#endif /* CONST_MATH_HPP */
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -47,6 +47,12 @@ typedef struct tlv_type_note_on_off_s
     uint8_t velocity;
 } PACKED tlv_type_note_on_off_t;
 
+#define TLV_TYPE_CHANNEL_PANIC 0x1e
+typedef struct tlv_type_channel_panic_s
+{
+    uint8_t channel;
+} PACKED tlv_type_channel_panic_t;
+
 #define TLV_TYPE_PANIC 0x1f
 typedef struct tlv_type_panic_s
 {
@@ -133,6 +139,31 @@ typedef struct tlv_type_led_color_s
     uint8_t b;
 } PACKED tlv_type_led_color_t;
 
+#define TLV_TYPE_SAMPLE_FREQ 0x50
+typedef struct tlv_type_sample_freq_s
+{
+    uint32_t sample_freq;
+} PACKED tlv_type_sample_freq_t;
+
+#define TLV_TYPE_PAN 0x51
+typedef struct tlv_type_pan_s
+{
+    uint64_t board_id;
+    uint8_t channel;
+    uint8_t pan;
+} PACKED tlv_type_pan_t;
+
+#define TLV_TYPE_ENVELOPE 0x52
+typedef struct tlv_type_envelope_s
+{
+    uint64_t board_id;
+    uint8_t channel;
+    uint8_t attack;
+    uint8_t decay;
+    uint8_t sustain;
+    uint8_t release;
+} PACKED tlv_type_envelope_t;
+
 
 #ifdef __cplusplus
 }
@@ -33,6 +33,8 @@
 #include "i2s-audio-target.hpp"
 #include "pico/stdlib.h"
 #include "pico/audio.h"
+#include "hardware/clocks.h"
+#include "hardware/pio.h"
 
 I2S_audio_target::I2S_audio_target(const uint32_t sample_freq,
                                    const uint8_t gpio_pin_i2s_clock_base,
@@ -47,10 +49,125 @@ I2S_audio_target::~I2S_audio_target()
 {
 }
 
+audio_buffer_t *
+I2S_audio_target::direct_producer_take(audio_connection_t *connection,
+                                       const bool block)
+{
+  return get_free_audio_buffer(connection->producer_pool, block);
+}
+
+void
+I2S_audio_target::direct_producer_give(audio_connection_t *connection,
+                                       audio_buffer_t *audio_buffer)
+{
+  queue_full_audio_buffer(connection->producer_pool, audio_buffer);
+}
+
+/*
+ * The PIO clock divider for a sample rate, computed the same way as
+ * pico-extras does: the I2S program takes 64 PIO cycles per frame,
+ * and the divider has 8 fractional bits.
+ */
+uint32_t
+I2S_audio_target::get_divider(const uint32_t sample_freq)
+{
+  return clock_get_hz(clk_sys) * 4 / sample_freq;
+}
+
+/*
+ * As the divider is truncated, the output runs slightly faster than
+ * the nominal sample rate, e.g. by 16ppm at 24kHz or 77ppm at
+ * 44.1kHz with a system clock of 125MHz, i.e. up to several hundred
+ * milliseconds per hour.
+ */
+void
+I2S_audio_target::get_frame_freq(uint32_t *const frame_freq_num,
+                                 uint32_t *const frame_freq_den) const
+{
+  *frame_freq_num = clock_get_hz(clk_sys) * 4;
+  *frame_freq_den = get_divider(get_sample_freq());
+}
+
+/*
+ * Only the direct connection knows when each buffer starts playing.
+ */
+bool
+I2S_audio_target::set_sample_clock(Sample_clock *const sample_clock)
+{
+  if (!_direct_dma) {
+    return false;
+  }
+  _direct_connection.sample_clock = sample_clock;
+  return true;
+}
+
+/*
+ * Called from the I2S DMA interrupt for the next buffer to play.  As
+ * this bypasses the pico-extras copying connection, which also
+ * follows changes of the sample rate, reprogram the PIO clock divider
+ * here the same way as pico-extras does.  The buffer taken starts
+ * playing right away, so this is where the sample clock is anchored
+ * to the sample time its producer tagged it with, at the actual
+ * frame rate, which is derived only when the divider changes.
+ * Re-anchoring on every buffer keeps the clock exact across underruns
+ * and sample rate switches.
+ */
+audio_buffer_t *
+I2S_audio_target::direct_consumer_take(audio_connection_t *connection,
+                                       const bool block)
+{
+  direct_connection_t *direct_connection =
+    (direct_connection_t *)connection;
+  const uint32_t sample_freq =
+    connection->producer_pool->format->sample_freq;
+  if (sample_freq != direct_connection->sample_freq) {
+    const uint32_t divider = get_divider(sample_freq);
+    pio_sm_set_clkdiv_int_frac(pio_get_instance(PICO_AUDIO_I2S_PIO),
+                               direct_connection->pio_sm,
+                               divider >> 8u, divider & 0xffu);
+    direct_connection->sample_freq = sample_freq;
+    direct_connection->divider = divider;
+    direct_connection->frames_per_us =
+      Sample_clock::get_frames_per_us(clock_get_hz(clk_sys) * 4, divider);
+  }
+  audio_buffer_t *audio_buffer =
+    get_full_audio_buffer(connection->producer_pool, block);
+  if (audio_buffer && direct_connection->sample_clock) {
+    // user_data holds the low 32 bits of the buffer's sample time
+    const uint64_t last_sample_time = direct_connection->sample_time;
+    const uint64_t sample_time = last_sample_time +
+      (uint32_t)(audio_buffer->user_data - (uint32_t)last_sample_time);
+    direct_connection->sample_time = sample_time;
+    direct_connection->sample_clock->
+      set_anchor(time_us_64(), sample_time,
+                 direct_connection->frames_per_us);
+  }
+  return audio_buffer;
+}
+
+void
+I2S_audio_target::direct_consumer_give(audio_connection_t *connection,
+                                       audio_buffer_t *audio_buffer)
+{
+  queue_free_audio_buffer(connection->producer_pool, audio_buffer);
+}
+
+/*
+ * With direct_dma, the I2S DMA plays the producer pool's buffers in
+ * place, which saves copying every sample once and the latency of
+ * the consumer pool; the synth must then render native stereo S16
+ * frames, which it does for I2S anyway.  Otherwise, pico-extras
+ * inserts a consumer pool of two buffers and copies each buffer into
+ * it, as before.
+ */
 void
 I2S_audio_target::init(const uint16_t buffer_count,
-                       const uint16_t buffer_sample_count)
+                       const uint16_t buffer_sample_count,
+                       const bool direct_dma)
 {
+  _buffer_count = buffer_count;
+  _buffer_sample_count = buffer_sample_count;
+  _direct_dma = direct_dma;
   _target_producer_pool =
     audio_new_producer_pool(&_target_audio_buffer_format,
                             buffer_count, buffer_sample_count);
@@ -61,9 +178,28 @@ I2S_audio_target::init(const uint16_t buffer_count,
   }
 
   const uint8_t channel_count = 2; // I2S is always stereo
+  audio_connection_t *connection = NULL;
+  if (direct_dma) {
+    _direct_connection.core.producer_pool_take = direct_producer_take;
+    _direct_connection.core.producer_pool_give = direct_producer_give;
+    _direct_connection.core.consumer_pool_take = direct_consumer_take;
+    _direct_connection.core.consumer_pool_give = direct_consumer_give;
+    _direct_connection.pio_sm = _target_audio_config.pio_sm;
+    _direct_connection.sample_freq = _target_audio_format.sample_freq;
+    _direct_connection.divider = get_divider(_direct_connection.sample_freq);
+    _direct_connection.frames_per_us =
+      Sample_clock::get_frames_per_us(clock_get_hz(clk_sys) * 4,
+                                      _direct_connection.divider);
+    _direct_connection.sample_clock = nullptr;
+    _direct_connection.sample_time = 0;
+    connection = &_direct_connection.core;
+  }
+  // with a direct connection, the consumer pool remains unused
   const __unused bool ok =
+    direct_dma ?
+    audio_i2s_connect_extra(_target_producer_pool, false, 1, 1, connection) :
     audio_i2s_connect_extra(_target_producer_pool, false, channel_count,
-                            buffer_sample_count * channel_count, NULL);
+                            buffer_sample_count * channel_count, connection);
   if (!ok) {
     panic("failed connecting I2S to producer pool");
   }
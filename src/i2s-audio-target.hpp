@@ -43,8 +43,38 @@ public:
                    const uint8_t gpio_pin_i2s_data);
   virtual ~I2S_audio_target();
   void init(const uint16_t buffer_count = DEFAULT_BUFFER_COUNT,
-            const uint16_t buffer_sample_count = DEFAULT_BUFFER_SAMPLE_COUNT);
+            const uint16_t buffer_sample_count = DEFAULT_BUFFER_SAMPLE_COUNT,
+            const bool direct_dma = false);
+  void get_frame_freq(uint32_t *const frame_freq_num,
+                      uint32_t *const frame_freq_den) const override;
+  bool set_sample_clock(Sample_clock *const sample_clock) override;
 private:
+  /*
+   * Connection that hands the producer's buffers to the I2S DMA as
+   * they are, rather than copying them into a consumer pool first.
+   * With a sample clock, it anchors the clock whenever a buffer
+   * starts playing.
+   */
+  typedef struct {
+    audio_connection_t core; // must be first
+    uint8_t pio_sm;
+    uint32_t sample_freq;
+    uint32_t divider; // 24.8 fixed point
+    uint64_t frames_per_us; // actual frame rate, see Sample_clock
+    Sample_clock *sample_clock;
+    uint64_t sample_time; // of the buffer taken last
+  } direct_connection_t;
+  bool _direct_dma = false;
+  static uint32_t get_divider(const uint32_t sample_freq);
+  static audio_buffer_t *direct_producer_take(audio_connection_t *connection,
+                                              const bool block);
+  static void direct_producer_give(audio_connection_t *connection,
+                                   audio_buffer_t *audio_buffer);
+  static audio_buffer_t *direct_consumer_take(audio_connection_t *connection,
+                                              const bool block);
+  static void direct_consumer_give(audio_connection_t *connection,
+                                   audio_buffer_t *audio_buffer);
+  direct_connection_t _direct_connection;
   struct audio_i2s_config _target_audio_config = {
     .data_pin = 255,
     .clock_pin_base = 255,
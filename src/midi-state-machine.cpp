@@ -31,27 +31,250 @@
  */
 
 #include "midi-state-machine.hpp"
-#include <math.h>
-#include "pico/stdlib.h"
-#include "bsp/board.h"
+#include <string.h>
+#include <array>
+#include "const-math.hpp"
+#include "osc-tables.hpp"
+#include "pico/platform.h"
 
-const double
-MIDI_state_machine::OCTAVE_FREQ_RATIO = 2.0;
+const uint8_t
+MIDI_state_machine::COUNT_HEADROOM_BITS;
+
+const uint32_t
+MIDI_state_machine::COUNT_INC;
+
+const size_t
+MIDI_state_machine::EVENT_QUEUE_SIZE;
+
+const size_t
+MIDI_state_machine::PENDING_EVENTS_SIZE;
+
+const uint64_t
+MIDI_state_machine::NO_PENDING_EVENT;
+
+const uint8_t
+MIDI_state_machine::PAN_CENTER;
+
+const uint8_t
+MIDI_state_machine::PAN_GAIN_BITS;
+
+const uint8_t
+MIDI_state_machine::PAN_GAIN_UNITY;
+
+const uint8_t
+MIDI_state_machine::PERCUSSION_CHANNEL;
+
+const size_t
+MIDI_state_machine::NUM_VOICES;
+
+const uint8_t
+MIDI_state_machine::NO_VOICE;
+
+const size_t
+MIDI_state_machine::NOTE_TABLE_SIZE;
+
+const uint8_t
+MIDI_state_machine::NUM_CONTROLLERS;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_MODULATION;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_PORTAMENTO_TIME;
 
 const uint8_t
-MIDI_state_machine::NOTES_PER_OCTAVE = 12;
+MIDI_state_machine::CONTROLLER_DATA_ENTRY;
 
-const double
-MIDI_state_machine::A4_FREQ = 440.0;
+const uint8_t
+MIDI_state_machine::CONTROLLER_VOLUME;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_PAN;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_EXPRESSION;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_HOLD;
 
 const uint8_t
-MIDI_state_machine::A4_NOTE_NUMBER = 69;
+MIDI_state_machine::CONTROLLER_PORTAMENTO;
 
 const uint8_t
-MIDI_state_machine::COUNT_HEADROOM_BITS = 0x8;
+MIDI_state_machine::CONTROLLER_PULSE_WIDTH;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_RELEASE;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_ATTACK;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_DECAY;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_LFO_RATE;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_SUSTAIN;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_ALL_SOUND_OFF;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_RESET_ALL;
+
+const uint8_t
+MIDI_state_machine::CONTROLLER_ALL_NOTES_OFF;
+
+const uint8_t
+MIDI_state_machine::DEFAULT_VOLUME;
+
+const uint8_t
+MIDI_state_machine::DEFAULT_EXPRESSION;
+
+const uint8_t
+MIDI_state_machine::HOLD_ON;
+
+const uint16_t
+MIDI_state_machine::PITCH_BEND_CENTER;
+
+const uint8_t
+MIDI_state_machine::DEFAULT_BEND_RANGE;
+
+const uint8_t
+MIDI_state_machine::MIN_BEND_RANGE;
+
+const uint8_t
+MIDI_state_machine::MAX_BEND_RANGE;
+
+const uint8_t
+MIDI_state_machine::NO_PITCH;
+
+const uint8_t
+MIDI_state_machine::GLIDE_FRACTION_BITS;
+
+const uint8_t
+MIDI_state_machine::PULSE_WIDTH_SQUARE;
+
+const uint8_t
+MIDI_state_machine::DEFAULT_LFO_RATE;
+
+const uint8_t
+MIDI_state_machine::DUTY_BITS;
+
+const uint16_t
+MIDI_state_machine::DUTY_FULL;
+
+const uint8_t
+MIDI_state_machine::DUTY_MIN;
+
+const uint8_t
+MIDI_state_machine::DUTY_MAX;
+
+const uint8_t
+MIDI_state_machine::DEFAULT_ATTACK;
+
+const uint8_t
+MIDI_state_machine::DEFAULT_DECAY;
+
+const uint8_t
+MIDI_state_machine::DEFAULT_SUSTAIN;
+
+const uint8_t
+MIDI_state_machine::DEFAULT_RELEASE;
+
+const uint8_t
+MIDI_state_machine::ENV_LEVEL_BITS;
 
 const uint32_t
-MIDI_state_machine::COUNT_INC = ((long)1u) << COUNT_HEADROOM_BITS;
+MIDI_state_machine::ENV_LEVEL_FULL;
+
+const uint8_t
+MIDI_state_machine::ENV_GAIN_BITS;
+
+const uint32_t
+MIDI_state_machine::ENVELOPE_TICK_FRAMES;
+
+const uint32_t
+MIDI_state_machine::LFO_TICK_FRAMES;
+
+const uint8_t
+MIDI_state_machine::ENV_ATTACK;
+
+const uint8_t
+MIDI_state_machine::ENV_DECAY;
+
+const uint8_t
+MIDI_state_machine::ENV_SUSTAIN;
+
+const uint8_t
+MIDI_state_machine::ENV_RELEASE;
+
+typedef std::array<uint16_t, 0x80> env_time_table_t;
+
+/*
+ * Envelope times [ms] by controller value: 0 is instant, and every
+ * further 10 steps double the time, from 1ms up to about 6.6s.
+ */
+static constexpr env_time_table_t
+make_env_time_table()
+{
+  env_time_table_t table{};
+  for (size_t value = 1; value < table.size(); value++) {
+    table[value] = const_round(const_exp2(value / 10.0));
+  }
+  return table;
+}
+
+static constexpr env_time_table_t ENV_TIME_TABLE = make_env_time_table();
+
+typedef std::array<uint16_t, 0x80> lfo_freq_table_t;
+
+/*
+ * LFO frequencies [mHz] by controller value: every 20 steps double
+ * the frequency, from 0.1Hz up to about 8.2Hz.
+ */
+static constexpr lfo_freq_table_t
+make_lfo_freq_table()
+{
+  lfo_freq_table_t table{};
+  for (size_t value = 0; value < table.size(); value++) {
+    table[value] = const_round(100.0 * const_exp2(value / 20.0));
+  }
+  return table;
+}
+
+static constexpr lfo_freq_table_t LFO_FREQ_TABLE = make_lfo_freq_table();
+
+static const uint8_t CONTROLLER_SOSTENUTO = 0x42;
+static const uint8_t CONTROLLER_SOFT = 0x43;
+static const uint8_t CONTROLLER_NRPN_LSB = 0x62;
+static const uint8_t CONTROLLER_NRPN_MSB = 0x63;
+static const uint8_t CONTROLLER_RPN_LSB = 0x64;
+static const uint8_t CONTROLLER_RPN_MSB = 0x65;
+static const uint8_t PARAMETER_NULL = 0x7f;
+static const uint8_t PARAMETER_BEND_RANGE = 0x00; // RPN MSB and LSB
+static const uint8_t PITCH_BITS = Osc_tables::PITCH_FRACTION_BITS;
+
+/*
+ * Controllers reset by "reset all controllers", with their reset
+ * values, see GM recommended practice RP-015; volume, pan and the
+ * sound controllers (envelope and pulse width) keep their values.
+ */
+static const uint8_t RESET_CONTROLLERS[][2] = {
+  { MIDI_state_machine::CONTROLLER_MODULATION, 0x00 },
+  { MIDI_state_machine::CONTROLLER_EXPRESSION,
+    MIDI_state_machine::DEFAULT_EXPRESSION },
+  { MIDI_state_machine::CONTROLLER_HOLD, 0x00 },
+  { MIDI_state_machine::CONTROLLER_PORTAMENTO, 0x00 },
+  { CONTROLLER_SOSTENUTO, 0x00 },
+  { CONTROLLER_SOFT, 0x00 },
+  { CONTROLLER_NRPN_LSB, PARAMETER_NULL },
+  { CONTROLLER_NRPN_MSB, PARAMETER_NULL },
+  { CONTROLLER_RPN_LSB, PARAMETER_NULL },
+  { CONTROLLER_RPN_MSB, PARAMETER_NULL }
+};
 
 MIDI_state_machine::MIDI_state_machine()
 {
@@ -61,76 +284,1086 @@ MIDI_state_machine::~MIDI_state_machine()
 {
 }
 
-void
+/*
+ * The oscillator parameters are precomputed for each supported
+ * sample rate (see osc-tables.cpp), such that no floating point math
+ * is needed at run time; returns false for an unsupported rate.
+ */
+bool
 MIDI_state_machine::osc_init(const uint32_t sample_freq)
 {
-  const double count_inc = COUNT_INC;
-  const double log_note_step_ratio = log(OCTAVE_FREQ_RATIO) / NOTES_PER_OCTAVE;
+  const uint32_t *osc_table = Osc_tables::lookup(sample_freq);
+  if (!osc_table) {
+    return false;
+  }
+  _osc_table = osc_table;
+  _sample_freq = sample_freq;
   for (size_t osc = 0; osc < NUM_OSC; osc++) {
-    const double osc_freq =
-      A4_FREQ * exp((osc - (double)A4_NOTE_NUMBER) * log_note_step_ratio);
-    // half (0.5) inc, since square wave elongation toggles twice per period
-    const uint32_t count_wrap =
-      round(0.5 * count_inc * sample_freq / osc_freq);
-    MIDI_state_machine::osc_status_t *osc_status = &_osc_statuses[osc];
-    osc_status->count_wrap = count_wrap;
-    osc_status->count = 0;
-    osc_status->velocity = 0;
-    osc_status->elongation = 0;
+    _osc_pitch[osc] = osc << PITCH_BITS;
+    _osc_rate[osc] = osc_table[osc];
+#ifdef USE_DDS_OSC
+    _osc_bank.phase_inc[osc] = osc_table[osc];
+    _osc_bank.phase[osc] = 0;
+#else
+    _osc_bank.count[osc] = 0;
+    _osc_magnitude_left[osc] = 0;
+    _osc_magnitude_right[osc] = 0;
+#endif
+    _osc_bank.velocity[osc] = 0;
+    _osc_bank.elongation_left[osc] = 0;
+    _osc_bank.elongation_right[osc] = 0;
+    _osc_channel[osc] = 0;
+    set_osc_duty(osc, DUTY_FULL / 2);
   }
+  _active_osc_count = 0;
+  return true;
 }
 
 void
 MIDI_state_machine::state_init()
 {
-  for (size_t channel = 0; channel < NUM_CHN; channel++) {
+  _voice_count = 0;
+  _ramping = false;
+  _gliding = false;
+  _lfo_channels = 0;
+  _retune_channels = 0;
+  memset(_note_voices, NO_VOICE, sizeof(_note_voices));
+  for (uint8_t channel = 0; channel < NUM_CHN; channel++) {
     channel_status_t *channel_status = &_midi_status.channel_status[channel];
-    for (size_t note = 0; note < NUM_OSC; note++) {
-      note_status_t *note_status = &channel_status->note_status[note];
-      note_status->velocity = 0;
+    uint8_t *controllers = &channel_status->controllers[0];
+    memset(controllers, 0, sizeof(channel_status->controllers));
+    for (const auto &reset_controller : RESET_CONTROLLERS) {
+      controllers[reset_controller[0]] = reset_controller[1];
     }
+    controllers[CONTROLLER_VOLUME] = DEFAULT_VOLUME;
+    controllers[CONTROLLER_PAN] = PAN_CENTER;
+    controllers[CONTROLLER_ATTACK] = DEFAULT_ATTACK;
+    controllers[CONTROLLER_DECAY] = DEFAULT_DECAY;
+    controllers[CONTROLLER_SUSTAIN] = DEFAULT_SUSTAIN;
+    controllers[CONTROLLER_RELEASE] = DEFAULT_RELEASE;
+    controllers[CONTROLLER_PULSE_WIDTH] = PULSE_WIDTH_SQUARE;
+    controllers[CONTROLLER_LFO_RATE] = DEFAULT_LFO_RATE;
+    memset(channel_status->held_notes, 0, sizeof(channel_status->held_notes));
+    memset(channel_status->sounding_notes, 0,
+           sizeof(channel_status->sounding_notes));
+    channel_status->bend = PITCH_BEND_CENTER;
+    channel_status->pitch_bend = 0;
+    channel_status->bend_range = DEFAULT_BEND_RANGE;
+    channel_status->last_pitch = NO_PITCH;
+    channel_status->program = 0;
+    channel_status->pressure = 0;
+    update_channel_gains(channel);
+    update_envelope_incs(channel_status);
+    channel_status->duty = DUTY_FULL / 2;
+    channel_status->lfo_phase = 0;
+    update_lfo_inc(channel_status);
+    update_glide_recip(channel_status);
   }
 }
 
+bool
+MIDI_state_machine::init(const uint32_t sample_freq)
+{
+  if (!osc_init(sample_freq)) {
+    return false;
+  }
+  _percussion_bank.init(sample_freq);
+  state_init();
+  return true;
+}
+
+/*
+ * Swap in the oscillator table of another sample rate while keeping
+ * all notes sounding; returns false for an unsupported rate.
+ */
+bool
+MIDI_state_machine::set_sample_freq(const uint32_t sample_freq)
+{
+  const uint32_t *osc_table = Osc_tables::lookup(sample_freq);
+  if (!osc_table) {
+    return false;
+  }
+  _osc_table = osc_table;
+  _sample_freq = sample_freq;
+  _percussion_bank.set_sample_freq(sample_freq);
+  for (size_t channel = 0; channel < NUM_CHN; channel++) {
+    update_envelope_incs(&_midi_status.channel_status[channel]);
+    update_lfo_inc(&_midi_status.channel_status[channel]);
+    update_glide_recip(&_midi_status.channel_status[channel]);
+  }
+  for (size_t osc = 0; osc < NUM_OSC; osc++) {
+    _osc_rate[osc] = Osc_tables::pitch_value(osc_table, _osc_pitch[osc]);
+#ifdef USE_DDS_OSC
+    _osc_bank.phase_inc[osc] = _osc_rate[osc];
+#endif
+    // a count beyond the new wrap just toggles with the next sample
+    set_osc_duty(osc, _osc_duty[osc]);
+  }
+  return true;
+}
+
 void
-MIDI_state_machine::led_init(const uint8_t gpio_pin_activity_indicator)
+MIDI_state_machine::set_activity_indicator(const activity_indicator_t
+                                           activity_indicator)
 {
-  _gpio_pin_activity_indicator = gpio_pin_activity_indicator;
-  gpio_init(gpio_pin_activity_indicator);
-  gpio_set_dir(gpio_pin_activity_indicator, GPIO_OUT);
+  _activity_indicator = activity_indicator;
 }
 
+MIDI_state_machine::osc_bank_t *
+MIDI_state_machine::get_osc_bank()
+{
+  return &_osc_bank;
+}
+
+Percussion_bank *
+MIDI_state_machine::get_percussion_bank()
+{
+  return &_percussion_bank;
+}
+
+/*
+ * Compatibility accessor: copies the state of all oscillators into
+ * one record per oscillator, as it used to be stored.
+ */
 void
-MIDI_state_machine::init(const uint32_t sample_freq,
-                         const uint8_t gpio_pin_activity_indicator)
+MIDI_state_machine::get_osc_statuses(osc_status_t *osc_statuses) const
 {
-  _timestamp_active_sensing = time_us_64();
-  osc_init(sample_freq);
-  state_init();
-  led_init(gpio_pin_activity_indicator);
-  board_init();
-  tusb_init();
+  for (size_t osc = 0; osc < NUM_OSC; osc++) {
+    osc_status_t *osc_status = &osc_statuses[osc];
+#ifdef USE_DDS_OSC
+    osc_status->phase_inc = _osc_bank.phase_inc[osc];
+    osc_status->phase = _osc_bank.phase[osc];
+    osc_status->pulse_width = _osc_bank.pulse_width[osc];
+#else
+    osc_status->count_wrap = _osc_bank.count_wrap[osc];
+    osc_status->count_wrap_next = _osc_bank.count_wrap_next[osc];
+    osc_status->count = _osc_bank.count[osc];
+#endif
+    osc_status->velocity = _osc_bank.velocity[osc];
+    osc_status->elongation_left = _osc_bank.elongation_left[osc];
+    osc_status->elongation_right = _osc_bank.elongation_right[osc];
+  }
+}
+
+const uint8_t *
+MIDI_state_machine::get_active_oscs() const
+{
+  return &_active_oscs[0];
+}
+
+size_t
+MIDI_state_machine::get_active_osc_count() const
+{
+  return _active_osc_count;
 }
 
-MIDI_state_machine::osc_status_t *
-MIDI_state_machine::get_osc_statuses()
+void
+MIDI_state_machine::activate_osc(const uint8_t osc)
+{
+  _active_osc_index[osc] = _active_osc_count;
+  _active_oscs[_active_osc_count++] = osc;
+}
+
+void
+MIDI_state_machine::deactivate_osc(const uint8_t osc)
+{
+  // move last entry into the gap, such that the list stays dense
+  const uint8_t index = _active_osc_index[osc];
+  const uint8_t last_osc = _active_oscs[--_active_osc_count];
+  _active_oscs[index] = last_osc;
+  _active_osc_index[last_osc] = index;
+}
+
+#ifndef USE_DDS_OSC
+/*
+ * Returns -1 while the oscillator is in the negative half of its
+ * period, 0 otherwise.  The renderer flips both elongations at each
+ * toggle, hence they carry the only record of the current half.
+ */
+int16_t
+MIDI_state_machine::get_osc_sign(const uint8_t osc) const
 {
-  return &_osc_statuses[0];
+  return -(int16_t)((_osc_bank.elongation_left[osc] |
+                     _osc_bank.elongation_right[osc]) < 0);
 }
+#endif
 
 void
 MIDI_state_machine::add_to_osc_status(const uint8_t pitch,
-                                      const int8_t delta_velocity)
-{
-  osc_status_t *osc_status = &_osc_statuses[pitch];
-  osc_status->velocity += delta_velocity;
-  const int16_t elongation = osc_status->elongation;
-  if (elongation > 0) {
-    osc_status->elongation += delta_velocity;
-  } else if (elongation < 0) {
-    osc_status->elongation -= delta_velocity;
+                                      const int8_t delta_velocity,
+                                      const int16_t delta_left,
+                                      const int16_t delta_right)
+{
+  int16_t *elongation_left = &_osc_bank.elongation_left[pitch];
+  int16_t *elongation_right = &_osc_bank.elongation_right[pitch];
+  const uint16_t velocity = _osc_bank.velocity[pitch];
+  const uint16_t new_velocity = velocity + delta_velocity;
+  _osc_bank.velocity[pitch] = new_velocity;
+#ifdef USE_DDS_OSC
+  // sign is taken from the phase, hence only track the magnitudes
+  *elongation_left += delta_left;
+  *elongation_right += delta_right;
+#else
+  /*
+   * Once both elongations were 0, the sign would be lost and the pulse
+   * would restart with inverted polarity mid-note.  Hence, the
+   * magnitudes are summed up apart from the sign, and while the
+   * oscillator is active, at least 1 is left on both sides, such as
+   * during the start of a slow attack or the tail of a release.
+   */
+  const int16_t sign = get_osc_sign(pitch);
+  int16_t magnitude_left = _osc_magnitude_left[pitch] += delta_left;
+  int16_t magnitude_right = _osc_magnitude_right[pitch] += delta_right;
+  if (new_velocity && !(magnitude_left | magnitude_right)) {
+    magnitude_left = 1;
+    magnitude_right = 1;
+  }
+  *elongation_left = (magnitude_left ^ sign) - sign;
+  *elongation_right = (magnitude_right ^ sign) - sign;
+#endif
+  if (!velocity && new_velocity) {
+    activate_osc(pitch);
+  } else if (velocity && !new_velocity) {
+    deactivate_osc(pitch);
+  }
+}
+
+static inline int16_t
+pan_velocity(const uint8_t velocity, const uint8_t gain)
+{
+  return (velocity * gain) >> MIDI_state_machine::PAN_GAIN_BITS;
+}
+
+/*
+ * Level increment per envelope tick for ramping over the full level
+ * range within the time of the given controller value; computed
+ * whenever a controller or the sample rate changes, such that the
+ * envelope ticks need no division.
+ */
+static uint32_t
+envelope_inc(const uint8_t value, const uint32_t sample_freq)
+{
+  const uint32_t tick_frames = MIDI_state_machine::ENVELOPE_TICK_FRAMES;
+  const uint64_t ramp_frames_1000 =
+    (uint64_t)ENV_TIME_TABLE[value] * sample_freq;
+  if (ramp_frames_1000 <= tick_frames * 1000) {
+    return MIDI_state_machine::ENV_LEVEL_FULL; // within a single tick
+  }
+  const uint32_t inc =
+    (uint64_t)MIDI_state_machine::ENV_LEVEL_FULL * tick_frames * 1000 /
+    ramp_frames_1000;
+  return inc ? inc : 1;
+}
+
+void
+MIDI_state_machine::update_envelope_incs(channel_status_t *channel_status)
+{
+  const uint8_t *controllers = &channel_status->controllers[0];
+  channel_status->attack_inc =
+    envelope_inc(controllers[CONTROLLER_ATTACK], _sample_freq);
+  channel_status->decay_inc =
+    envelope_inc(controllers[CONTROLLER_DECAY], _sample_freq);
+  channel_status->release_inc =
+    envelope_inc(controllers[CONTROLLER_RELEASE], _sample_freq);
+  channel_status->sustain_level =
+    (uint64_t)ENV_LEVEL_FULL * controllers[CONTROLLER_SUSTAIN] / 0x7f;
+}
+
+size_t
+MIDI_state_machine::get_voice_count() const
+{
+  return _voice_count;
+}
+
+/*
+ * Besides envelopes, drum decays, glides and pending bends are
+ * stepped on the envelope ticks.
+ */
+bool
+MIDI_state_machine::has_ramping_voices() const
+{
+  return _ramping || _gliding || _retune_channels ||
+    _percussion_bank.get_voice_count();
+}
+
+bool
+MIDI_state_machine::has_lfo_modulation() const
+{
+  return _lfo_channels && _voice_count;
+}
+
+/*
+ * Voices beyond the limit are stolen right away; new notes beyond
+ * the limit steal a voice, see steal_voice().
+ */
+void
+MIDI_state_machine::set_voice_limit(const size_t voice_limit)
+{
+  _voice_limit =
+    voice_limit < 1 ? 1 : voice_limit > NUM_VOICES ? NUM_VOICES : voice_limit;
+  while (_voice_count > _voice_limit) {
+    steal_voice();
+  }
+}
+
+size_t
+MIDI_state_machine::get_voice_limit() const
+{
+  return _voice_limit;
+}
+
+uint32_t
+MIDI_state_machine::get_stolen_voice_count() const
+{
+  return _stolen_voice_count;
+}
+
+uint32_t
+MIDI_state_machine::get_dropped_event_count() const
+{
+  return _dropped_event_count;
+}
+
+/*
+ * Stealing policy: cut off the quietest voice, i.e. the one with the
+ * lowest product of velocity and envelope level, such that fading
+ * releases go first; among equally quiet voices, the oldest one.
+ */
+void
+MIDI_state_machine::steal_voice()
+{
+  const uint8_t level_shift = ENV_LEVEL_BITS - ENV_GAIN_BITS;
+  uint8_t quietest = 0;
+  uint32_t quietest_loudness = UINT32_MAX;
+  for (uint8_t index = 0; index < _voice_count; index++) {
+    const voice_t *voice = &_voices[index];
+    const uint32_t loudness = voice->velocity * (voice->level >> level_shift);
+    if ((loudness < quietest_loudness) ||
+        ((loudness == quietest_loudness) &&
+         ((int32_t)(voice->serial - _voices[quietest].serial) < 0))) {
+      quietest = index;
+      quietest_loudness = loudness;
+    }
+  }
+  free_voice(quietest);
+  _stolen_voice_count++;
+}
+
+static inline size_t
+note_hash(const uint8_t channel, const uint8_t pitch)
+{
+  const uint32_t key = ((uint32_t)channel << 7) | pitch;
+  return (key * 0x9e3779b1u) >> 24; // Fibonacci hashing, 8 bits
+}
+static_assert(MIDI_state_machine::NOTE_TABLE_SIZE == 0x100,
+              "note hash yields 8 bits");
+
+/*
+ * The note table maps each sounding note to its voice by linear
+ * probing, keyed by the channel and pitch of the voice an entry
+ * refers to.  Returns the slot holding the note or, if there is
+ * none, the empty slot where it belongs.  As there are at most
+ * NUM_VOICES entries, at least half of the slots are always empty.
+ */
+size_t
+MIDI_state_machine::find_note_slot(const uint8_t channel,
+                                   const uint8_t pitch) const
+{
+  size_t slot = note_hash(channel, pitch);
+  for (;;) {
+    const uint8_t index = _note_voices[slot];
+    if ((index == NO_VOICE) ||
+        ((_voices[index].pitch == pitch) &&
+         (_voices[index].channel == channel))) {
+      return slot;
+    }
+    slot = (slot + 1) & (NOTE_TABLE_SIZE - 1);
+  }
+}
+
+/*
+ * Notes not marked in sounding_notes are rejected without probing.
+ */
+uint8_t
+MIDI_state_machine::find_note_voice(const uint8_t channel,
+                                    const uint8_t pitch) const
+{
+  const channel_status_t *channel_status =
+    &_midi_status.channel_status[channel];
+  if (!(channel_status->sounding_notes[pitch >> 5] &
+        (1u << (pitch & 0x1f)))) {
+    return NO_VOICE;
+  }
+  return _note_voices[find_note_slot(channel, pitch)];
+}
+
+/*
+ * Empty the slot, and move later entries of the same probe sequence
+ * back into the gap, such that lookups never need tombstones.
+ */
+void
+MIDI_state_machine::remove_note_slot(size_t slot)
+{
+  const size_t mask = NOTE_TABLE_SIZE - 1;
+  for (size_t next = (slot + 1) & mask; _note_voices[next] != NO_VOICE;
+       next = (next + 1) & mask) {
+    const voice_t *voice = &_voices[_note_voices[next]];
+    const size_t home = note_hash(voice->channel, voice->pitch);
+    if (((next - home) & mask) >= ((next - slot) & mask)) {
+      _note_voices[slot] = _note_voices[next];
+      slot = next;
+    }
+  }
+  _note_voices[slot] = NO_VOICE;
+}
+
+/*
+ * Take a voice from the pool for a note starting on the given channel.
+ */
+uint8_t
+MIDI_state_machine::alloc_voice(const uint8_t channel, const uint8_t pitch)
+{
+  if (_voice_count >= _voice_limit) {
+    steal_voice();
+  }
+  const uint8_t index = _voice_count++;
+  voice_t *voice = &_voices[index];
+  voice->level = 0;
+  voice->elongation_left = 0;
+  voice->elongation_right = 0;
+  voice->channel = channel;
+  voice->pitch = pitch;
+  voice->velocity = 0;
+  voice->stage = ENV_ATTACK;
+  voice->glide = 0;
+  _note_voices[find_note_slot(channel, pitch)] = index;
+  _midi_status.channel_status[channel].sounding_notes[pitch >> 5] |=
+    1u << (pitch & 0x1f);
+  return index;
+}
+
+/*
+ * Remove whatever the voice still contributes to its oscillator, and
+ * return it to the pool, keeping the voices dense; the note table
+ * entry of the voice moved into the gap is redirected.
+ */
+void
+MIDI_state_machine::free_voice(const uint8_t index)
+{
+  voice_t *voice = &_voices[index];
+  add_to_osc_status(voice->pitch, -voice->velocity,
+                    -voice->elongation_left, -voice->elongation_right);
+  remove_note_slot(find_note_slot(voice->channel, voice->pitch));
+  _midi_status.channel_status[voice->channel].
+    sounding_notes[voice->pitch >> 5] &= ~(1u << (voice->pitch & 0x1f));
+  const uint8_t last = --_voice_count;
+  if (index != last) {
+    *voice = _voices[last];
+    _note_voices[find_note_slot(voice->channel, voice->pitch)] = index;
+  }
+}
+
+/*
+ * Advance the envelope of the voice by one tick; returns false as
+ * soon as a released voice has faded out.  Stages reaching their
+ * target level within a tick stop there rather than overshoot.
+ */
+bool
+MIDI_state_machine::step_envelope(voice_t *voice)
+{
+  const channel_status_t *channel_status =
+    &_midi_status.channel_status[voice->channel];
+  const uint32_t sustain_level = channel_status->sustain_level;
+  uint32_t level = voice->level;
+  if (voice->stage == ENV_ATTACK) {
+    if (ENV_LEVEL_FULL - level > channel_status->attack_inc) {
+      level += channel_status->attack_inc;
+    } else {
+      level = ENV_LEVEL_FULL;
+      voice->stage = level > sustain_level ? ENV_DECAY : ENV_SUSTAIN;
+    }
+  } else if (voice->stage == ENV_DECAY) {
+    if (level > sustain_level + channel_status->decay_inc) {
+      level -= channel_status->decay_inc;
+    } else {
+      level = level < sustain_level ? level : sustain_level;
+      voice->stage = ENV_SUSTAIN;
+    }
+  } else if (voice->stage == ENV_RELEASE) {
+    if (level > channel_status->release_inc) {
+      level -= channel_status->release_inc;
+    } else {
+      voice->level = 0;
+      return false;
+    }
+  }
+  voice->level = level;
+  return true;
+}
+
+/*
+ * Scale the panned velocity of the voice by its envelope level, and
+ * pass the difference to what it contributed so far on to its
+ * oscillator.  At full level, the elongations are exactly the panned
+ * velocities.
+ */
+void
+MIDI_state_machine::update_voice_elongations(voice_t *voice)
+{
+  const channel_status_t *channel_status =
+    &_midi_status.channel_status[voice->channel];
+  const int32_t gain = voice->level >> (ENV_LEVEL_BITS - ENV_GAIN_BITS);
+  const int16_t elongation_left =
+    (pan_velocity(voice->velocity, channel_status->gain_left) * gain) >>
+    ENV_GAIN_BITS;
+  const int16_t elongation_right =
+    (pan_velocity(voice->velocity, channel_status->gain_right) * gain) >>
+    ENV_GAIN_BITS;
+  if ((elongation_left == voice->elongation_left) &&
+      (elongation_right == voice->elongation_right)) {
+    return; // slow ramps change the elongations only every few ticks
+  }
+  add_to_osc_status(voice->pitch, 0,
+                    elongation_left - voice->elongation_left,
+                    elongation_right - voice->elongation_right);
+  voice->elongation_left = elongation_left;
+  voice->elongation_right = elongation_right;
+}
+
+/*
+ * A note on (re)starts the attack of the note's voice from its
+ * current level, a note off starts its release.  The first envelope
+ * step is taken right away, such that the note starts or ends on the
+ * exact sample of the event; all further steps follow on the
+ * envelope ticks.
+ */
+void
+MIDI_state_machine::set_note_velocity(const uint8_t channel,
+                                      const uint8_t pitch,
+                                      const uint8_t velocity)
+{
+  channel_status_t *channel_status = &_midi_status.channel_status[channel];
+  uint8_t index = find_note_voice(channel, pitch);
+  if (velocity) {
+    channel_status->held_notes[pitch >> 5] &= ~(1u << (pitch & 0x1f));
+    if (index == NO_VOICE) {
+      index = alloc_voice(channel, pitch);
+    }
+    voice_t *voice = &_voices[index];
+    add_to_osc_status(pitch, velocity - voice->velocity, 0, 0);
+    _osc_channel[pitch] = channel;
+    if (_osc_duty[pitch] != channel_status->duty) {
+      set_osc_duty(pitch, channel_status->duty);
+    }
+    voice->velocity = velocity;
+    voice->serial = _voice_serial++;
+    voice->stage = ENV_ATTACK;
+    start_glide(voice);
+    update_voice_pitch(voice);
+  } else if (index != NO_VOICE) {
+    _voices[index].stage = ENV_RELEASE;
+  } else {
+    return; // already faded out, or cut off
+  }
+  voice_t *voice = &_voices[index];
+  if (!step_envelope(voice)) {
+    free_voice(index);
+    return;
+  }
+  update_voice_elongations(voice);
+  if (voice->stage != ENV_SUSTAIN) {
+    _ramping = true;
+  }
+}
+
+/*
+ * While the hold pedal is down, a released key just marks its note
+ * as held, such that it keeps sounding until the pedal goes up.
+ */
+void
+MIDI_state_machine::note_off(const uint8_t channel, const uint8_t pitch)
+{
+  channel_status_t *channel_status = &_midi_status.channel_status[channel];
+  if ((channel_status->controllers[CONTROLLER_HOLD] >= HOLD_ON) &&
+      (channel_status->sounding_notes[pitch >> 5] &
+       (1u << (pitch & 0x1f)))) {
+    channel_status->held_notes[pitch >> 5] |= 1u << (pitch & 0x1f);
+    return;
+  }
+  set_note_velocity(channel, pitch, 0);
+}
+
+/*
+ * Lifting the hold pedal releases all held notes, visiting just the
+ * set bits of held_notes.
+ */
+void
+MIDI_state_machine::set_channel_hold(const uint8_t channel, const bool hold)
+{
+  if (hold) {
+    return;
+  }
+  channel_status_t *channel_status = &_midi_status.channel_status[channel];
+  for (uint8_t word = 0; word < NUM_OSC / 32; word++) {
+    uint32_t held = channel_status->held_notes[word];
+    channel_status->held_notes[word] = 0;
+    while (held) {
+      const uint8_t pitch = (word << 5) | __builtin_ctz(held);
+      held &= held - 1;
+      set_note_velocity(channel, pitch, 0);
+    }
+  }
+}
+
+/*
+ * Called by the renderer on every envelope tick, i.e. whenever the
+ * sample time is a multiple of ENVELOPE_TICK_FRAMES, as long as any
+ * voice is ramping.  Sustaining voices cost just a check.
+ */
+void
+MIDI_state_machine::update_envelopes()
+{
+  if (_percussion_bank.get_voice_count()) {
+    _percussion_bank.update();
+  }
+  for (uint8_t channel = 0; _retune_channels; channel++) {
+    if (_retune_channels & (1u << channel)) {
+      _retune_channels &= ~(1u << channel);
+      retune_channel(channel);
+    }
+  }
+  if (!_ramping && !_gliding) {
+    return;
+  }
+  bool ramping = false;
+  bool gliding = false;
+  for (size_t index = 0; index < _voice_count;) {
+    voice_t *voice = &_voices[index];
+    if (voice->glide) {
+      const int32_t glide = voice->glide;
+      const int32_t step = voice->glide_step;
+      voice->glide =
+        glide > step ? glide - step : glide < -step ? glide + step : 0;
+      update_voice_pitch(voice);
+      gliding |= voice->glide != 0;
+    }
+    if (voice->stage != ENV_SUSTAIN) {
+      if (!step_envelope(voice)) {
+        free_voice(index);
+        continue; // the last voice moved into this slot
+      }
+      update_voice_elongations(voice);
+      ramping |= voice->stage != ENV_SUSTAIN;
+    }
+    index++;
+  }
+  _ramping = ramping;
+  _gliding = gliding;
+}
+
+/*
+ * Balance law: the centered channel plays at full level on both
+ * sides, such that unpanned output stays exactly as loud as before;
+ * moving away from the center attenuates the opposite side linearly
+ * down to silence at the extreme position.  Volume and expression
+ * both scale the gains linearly, and leave them at unity at their
+ * defaults.  Notes already sounding on the channel follow the new
+ * gains immediately.
+ */
+void
+MIDI_state_machine::update_channel_gains(const uint8_t channel)
+{
+  channel_status_t *channel_status = &_midi_status.channel_status[channel];
+  const uint8_t *controllers = &channel_status->controllers[0];
+  const uint8_t pan = controllers[CONTROLLER_PAN];
+  const uint32_t pan_gain_left =
+    pan <= PAN_CENTER ? PAN_GAIN_UNITY :
+    ((0x7f - pan) * PAN_GAIN_UNITY + (0x7f - PAN_CENTER) / 2) /
+    (0x7f - PAN_CENTER);
+  const uint32_t pan_gain_right =
+    pan >= PAN_CENTER ? PAN_GAIN_UNITY :
+    (pan * PAN_GAIN_UNITY + PAN_CENTER / 2) / PAN_CENTER;
+  const uint32_t level =
+    controllers[CONTROLLER_VOLUME] * controllers[CONTROLLER_EXPRESSION];
+  const uint32_t level_unity = DEFAULT_VOLUME * DEFAULT_EXPRESSION;
+  channel_status->gain_left =
+    (pan_gain_left * level + level_unity / 2) / level_unity;
+  channel_status->gain_right =
+    (pan_gain_right * level + level_unity / 2) / level_unity;
+  for (size_t index = 0; index < _voice_count; index++) {
+    voice_t *voice = &_voices[index];
+    if (voice->channel == channel) {
+      update_voice_elongations(voice);
+    }
+  }
+}
+
+/*
+ * The duty cycle scales both halves of the oscillator's period (two
+ * count wraps, or the phase threshold) while keeping the period, and
+ * thereby the pitch, exact.  The current half keeps its sign, which
+ * is never lost while the oscillator is active (see
+ * add_to_osc_status()).
+ */
+void
+MIDI_state_machine::set_osc_duty(const uint8_t osc, const uint8_t duty)
+{
+  _osc_duty[osc] = duty;
+#ifdef USE_DDS_OSC
+  _osc_bank.pulse_width[osc] = ((uint32_t)duty) << (32 - DUTY_BITS);
+#else
+  // see pulse_periods_fit() in osc-tables.cpp
+  const uint32_t period = 2 * _osc_rate[osc];
+  const uint32_t high = (period * duty) >> DUTY_BITS;
+  const uint32_t low = period - high;
+  if (get_osc_sign(osc)) {
+    _osc_bank.count_wrap[osc] = low;
+    _osc_bank.count_wrap_next[osc] = high;
   } else {
-    osc_status->elongation = delta_velocity;
+    _osc_bank.count_wrap[osc] = high;
+    _osc_bank.count_wrap_next[osc] = low;
+  }
+#endif
+}
+
+/*
+ * Retuning takes a single multiplication (see Osc_tables), and
+ * nothing at all while the pitch stays the same.
+ */
+void
+MIDI_state_machine::retune_osc(const uint8_t osc, const int32_t pitch)
+{
+  if (_osc_pitch[osc] == pitch) {
+    return;
+  }
+  _osc_pitch[osc] = pitch;
+  _osc_rate[osc] = Osc_tables::pitch_value(_osc_table, pitch);
+#ifdef USE_DDS_OSC
+  _osc_bank.phase_inc[osc] = _osc_rate[osc];
+#else
+  // a count beyond the new wrap just toggles with the next sample
+  set_osc_duty(osc, _osc_duty[osc]);
+#endif
+}
+
+/*
+ * The voice's pitch is its note, bent by its channel and moved by
+ * its glide.  As with the duty cycle, a note played on several
+ * channels at once follows the channel that started it last.
+ */
+void
+MIDI_state_machine::update_voice_pitch(const voice_t *voice)
+{
+  if (_osc_channel[voice->pitch] != voice->channel) {
+    return;
+  }
+  const int32_t pitch =
+    (voice->pitch << PITCH_BITS) +
+    _midi_status.channel_status[voice->channel].pitch_bend +
+    (voice->glide >> (GLIDE_FRACTION_BITS - PITCH_BITS));
+  retune_osc(voice->pitch, pitch);
+}
+
+/*
+ * A bend of the full 14 bit range spans twice the bend range.  The
+ * oscillators follow on the next envelope tick, such that a dense
+ * stream of bend messages costs no more than one retuning of the
+ * channel's voices per tick.
+ */
+void
+MIDI_state_machine::update_channel_bend(const uint8_t channel)
+{
+  channel_status_t *channel_status = &_midi_status.channel_status[channel];
+  const int32_t bend = (int32_t)channel_status->bend - PITCH_BEND_CENTER;
+  // 0x2000 steps per bend range, 1 << PITCH_BITS per semitone, rounded
+  const uint8_t shift = 13 - PITCH_BITS;
+  channel_status->pitch_bend =
+    (bend * channel_status->bend_range + (1 << (shift - 1))) >> shift;
+  _retune_channels |= 1u << channel;
+}
+
+void
+MIDI_state_machine::retune_channel(const uint8_t channel)
+{
+  for (size_t index = 0; index < _voice_count; index++) {
+    if (_voices[index].channel == channel) {
+      update_voice_pitch(&_voices[index]);
+    }
+  }
+}
+
+/*
+ * Portamento time controller values select the same times as the
+ * envelope controllers; a glide takes this time for any distance.
+ */
+void
+MIDI_state_machine::update_glide_recip(channel_status_t *channel_status)
+{
+  const uint8_t value = channel_status->controllers[CONTROLLER_PORTAMENTO_TIME];
+  const uint32_t ticks =
+    (uint64_t)ENV_TIME_TABLE[value] * _sample_freq /
+    (1000 * ENVELOPE_TICK_FRAMES);
+  channel_status->glide_recip =
+    ticks > 1 ? (uint32_t)((((uint64_t)1u) << 32) / ticks) : 0;
+}
+
+/*
+ * With portamento on, a new note glides from the channel's previous
+ * note to its own pitch in linear steps on the envelope ticks.
+ */
+void
+MIDI_state_machine::start_glide(voice_t *voice)
+{
+  channel_status_t *channel_status =
+    &_midi_status.channel_status[voice->channel];
+  const uint8_t last_pitch = channel_status->last_pitch;
+  channel_status->last_pitch = voice->pitch;
+  if ((channel_status->controllers[CONTROLLER_PORTAMENTO] < 0x40) ||
+      !channel_status->glide_recip || (last_pitch == NO_PITCH)) {
+    voice->glide = 0;
+    return;
+  }
+  const int32_t glide =
+    ((int32_t)last_pitch - voice->pitch) * (1 << GLIDE_FRACTION_BITS);
+  const uint32_t distance = glide < 0 ? -glide : glide;
+  const uint32_t step =
+    ((uint64_t)distance * channel_status->glide_recip) >> 32;
+  voice->glide = glide;
+  voice->glide_step = step ? step : 1;
+  if (glide) {
+    _gliding = true;
+  }
+}
+
+void
+MIDI_state_machine::update_lfo_inc(channel_status_t *channel_status)
+{
+  const uint64_t phase_turn = ((uint64_t)1u) << 32;
+  const uint8_t lfo_rate = channel_status->controllers[CONTROLLER_LFO_RATE];
+  channel_status->lfo_phase_inc =
+    LFO_FREQ_TABLE[lfo_rate] * LFO_TICK_FRAMES *
+    phase_turn / ((uint64_t)_sample_freq * 1000);
+}
+
+/*
+ * Derive the channel's duty cycle from its pulse width and the
+ * triangle of its LFO, and pass it on to all oscillators whose
+ * latest voice was started on the channel.  As oscillators are
+ * shared by all channels, a note played on several channels at once
+ * takes the pulse width of the channel that started it last.
+ */
+void
+MIDI_state_machine::update_channel_duty(const uint8_t channel)
+{
+  channel_status_t *channel_status = &_midi_status.channel_status[channel];
+  const uint8_t *controllers = &channel_status->controllers[0];
+  int32_t duty = 2 * controllers[CONTROLLER_PULSE_WIDTH];
+  const int32_t lfo_depth = controllers[CONTROLLER_MODULATION];
+  if (lfo_depth) {
+    const int32_t ramp = channel_status->lfo_phase >> (32 - 9); // 0..0x1ff
+    const int32_t triangle = (ramp < 0x100 ? ramp : 0x1ff - ramp) - 0x80;
+    duty += (triangle * lfo_depth) >> 8;
+  }
+  duty = duty < DUTY_MIN ? DUTY_MIN : duty > DUTY_MAX ? DUTY_MAX : duty;
+  if (duty == channel_status->duty) {
+    return; // slow LFOs change the duty only every few ticks
+  }
+  channel_status->duty = duty;
+  for (size_t index = 0; index < _voice_count; index++) {
+    const uint8_t pitch = _voices[index].pitch;
+    if ((_voices[index].channel == channel) &&
+        (_osc_channel[pitch] == channel)) {
+      set_osc_duty(pitch, duty);
+    }
+  }
+}
+
+/*
+ * Called by the renderer on every LFO tick, i.e. whenever the sample
+ * time is a multiple of LFO_TICK_FRAMES, as long as any LFO modulates
+ * a sounding channel.  As the duty cycle just moves the toggles
+ * within each period, a coarse tick suffices; with buffers of
+ * LFO_TICK_FRAMES, LFO ticks fall onto buffer boundaries and thus
+ * cost no extra blocks.
+ */
+void
+MIDI_state_machine::update_lfos()
+{
+  if (!has_lfo_modulation()) {
+    return;
+  }
+  for (uint8_t channel = 0; channel < NUM_CHN; channel++) {
+    if (_lfo_channels & (1u << channel)) {
+      channel_status_t *channel_status =
+        &_midi_status.channel_status[channel];
+      channel_status->lfo_phase += channel_status->lfo_phase_inc;
+      update_channel_duty(channel);
+    }
+  }
+}
+
+/*
+ * Resets the controllers listed in RESET_CONTROLLERS, and pitch bend
+ * and channel pressure, through control_change(), such that held
+ * notes are released and the modulation stops.
+ */
+void
+MIDI_state_machine::reset_controllers(const uint8_t channel)
+{
+  channel_status_t *channel_status = &_midi_status.channel_status[channel];
+  channel_status->bend = PITCH_BEND_CENTER;
+  channel_status->pressure = 0;
+  update_channel_bend(channel);
+  for (const auto &reset_controller : RESET_CONTROLLERS) {
+    control_change(channel, reset_controller[0], reset_controller[1]);
+  }
+}
+
+/*
+ * Release all keys that are down on the channel, as if a note off
+ * arrived for each; while the hold pedal is down, they are just
+ * marked as held.  Only the notes marked in sounding_notes are
+ * visited.
+ */
+void
+MIDI_state_machine::all_notes_off(const uint8_t channel)
+{
+  channel_status_t *channel_status = &_midi_status.channel_status[channel];
+  for (uint8_t word = 0; word < NUM_OSC / 32; word++) {
+    uint32_t sounding = channel_status->sounding_notes[word];
+    while (sounding) {
+      const uint8_t pitch = (word << 5) | __builtin_ctz(sounding);
+      sounding &= sounding - 1;
+      if (get_note_velocity(channel, pitch)) {
+        note_off(channel, pitch);
+      }
+    }
+  }
+}
+
+/*
+ * Cut off all voices of the channel at once, skipping their release,
+ * regardless of the hold pedal; on the percussion channel, all drums
+ * are cut off.  Costs one step per sounding note.
+ */
+void
+MIDI_state_machine::all_sound_off(const uint8_t channel)
+{
+  if (channel == PERCUSSION_CHANNEL) {
+    _percussion_bank.cut_all();
+  }
+  channel_status_t *channel_status = &_midi_status.channel_status[channel];
+  for (uint8_t word = 0; word < NUM_OSC / 32; word++) {
+    uint32_t sounding = channel_status->sounding_notes[word];
+    channel_status->held_notes[word] = 0;
+    while (sounding) {
+      const uint8_t pitch = (word << 5) | __builtin_ctz(sounding);
+      sounding &= sounding - 1;
+      free_voice(find_note_voice(channel, pitch));
+    }
+  }
+}
+
+/*
+ * Back to a silent synth with all controllers reset, e.g. after stuck
+ * notes, at a cost proportional to the notes that are actually
+ * sounding rather than to all notes of all channels.
+ */
+void
+MIDI_state_machine::reset()
+{
+  for (uint8_t channel = 0; channel < NUM_CHN; channel++) {
+    all_sound_off(channel);
+    reset_controllers(channel);
+  }
+}
+
+const MIDI_state_machine::channel_status_t *
+MIDI_state_machine::get_channel_status(const uint8_t channel) const
+{
+  return &_midi_status.channel_status[channel];
+}
+
+/*
+ * Returns the velocity of the key, or 0 while the key is up, even if
+ * its note is still sounding, held by the pedal or fading out.
+ */
+uint8_t
+MIDI_state_machine::get_note_velocity(const uint8_t channel,
+                                      const uint8_t pitch) const
+{
+  const uint8_t index = find_note_voice(channel, pitch);
+  if ((index == NO_VOICE) || (_voices[index].stage == ENV_RELEASE) ||
+      (_midi_status.channel_status[channel].held_notes[pitch >> 5] &
+       (1u << (pitch & 0x1f)))) {
+    return 0;
+  }
+  return _voices[index].velocity;
+}
+
+/*
+ * Store the controller's new value and update whatever the synth
+ * derives from it; all other controllers are just kept.  The pulse
+ * width controller value 0x40 selects a square wave, lower and higher
+ * values narrow down the positive or negative half of the period to
+ * about 5%.  The modulation wheel sets the depth of a triangle LFO
+ * that sweeps the pulse width by up to about +/-25% of the period, at
+ * 0.1Hz up to about 8.2Hz, see LFO_FREQ_TABLE.  Attack, decay and
+ * release controller values select times from 0 (instant) up to
+ * about 6.6s, see ENV_TIME_TABLE; the sustain value selects the level
+ * relative to full velocity.  New times apply to ramps in progress; a
+ * new sustain level applies to voices from their next decay on.
+ */
+void
+MIDI_state_machine::control_change(const uint8_t channel,
+                                   const uint8_t controller,
+                                   const uint8_t value)
+{
+  if (controller >= NUM_CONTROLLERS) {
+    if (controller == CONTROLLER_ALL_SOUND_OFF) {
+      all_sound_off(channel);
+    } else if (controller == CONTROLLER_RESET_ALL) {
+      reset_controllers(channel);
+    } else if (controller >= CONTROLLER_ALL_NOTES_OFF) {
+      // omni and mono/poly mode changes turn all notes off, too
+      all_notes_off(channel);
+    }
+    return;
+  }
+  channel_status_t *channel_status = &_midi_status.channel_status[channel];
+  channel_status->controllers[controller] = value;
+  if ((controller == CONTROLLER_PAN) || (controller == CONTROLLER_VOLUME) ||
+      (controller == CONTROLLER_EXPRESSION)) {
+    update_channel_gains(channel);
+  } else if ((controller == CONTROLLER_ATTACK) ||
+             (controller == CONTROLLER_DECAY) ||
+             (controller == CONTROLLER_SUSTAIN) ||
+             (controller == CONTROLLER_RELEASE)) {
+    update_envelope_incs(channel_status);
+  } else if (controller == CONTROLLER_PULSE_WIDTH) {
+    update_channel_duty(channel);
+  } else if (controller == CONTROLLER_MODULATION) {
+    if (value) {
+      _lfo_channels |= 1u << channel;
+    } else {
+      _lfo_channels &= ~(1u << channel);
+    }
+    update_channel_duty(channel);
+  } else if (controller == CONTROLLER_LFO_RATE) {
+    update_lfo_inc(channel_status);
+  } else if (controller == CONTROLLER_HOLD) {
+    set_channel_hold(channel, value >= HOLD_ON);
+  } else if (controller == CONTROLLER_PORTAMENTO_TIME) {
+    update_glide_recip(channel_status);
+  } else if ((controller == CONTROLLER_DATA_ENTRY) &&
+             (channel_status->controllers[CONTROLLER_RPN_MSB] ==
+              PARAMETER_BEND_RANGE) &&
+             (channel_status->controllers[CONTROLLER_RPN_LSB] ==
+              PARAMETER_BEND_RANGE)) {
+    channel_status->bend_range =
+      value < MIN_BEND_RANGE ? MIN_BEND_RANGE :
+      value > MAX_BEND_RANGE ? MAX_BEND_RANGE : value;
+    update_channel_bend(channel);
   }
 }
 
@@ -146,69 +1379,203 @@ MIDI_state_machine::consume_event_packet(const uint8_t *event_packet)
 
   const uint8_t channel = event_packet[1] & 0xf;
   const uint8_t pitch = event_packet[2] & 0x7f;
-  channel_status_t *channel_status = &_midi_status.channel_status[channel];
-  note_status_t *note_status = &channel_status->note_status[pitch];
 
-  if (code_index_number == 0x9) {
+  if ((channel == PERCUSSION_CHANNEL) && (code_index_number == 0x9)) {
+    // drums are one-shots, thus note offs are ignored
+    const uint8_t velocity = event_packet[3] & 0x7f;
+    if (velocity) {
+      const channel_status_t *channel_status =
+        &_midi_status.channel_status[channel];
+      _percussion_bank.trigger(pitch,
+                               pan_velocity(velocity,
+                                            channel_status->gain_left),
+                               pan_velocity(velocity,
+                                            channel_status->gain_right));
+    }
+    if (_activity_indicator) {
+      _activity_indicator(velocity > 0);
+    }
+  } else if ((channel == PERCUSSION_CHANNEL) && (code_index_number == 0x8)) {
+    if (_activity_indicator) {
+      _activity_indicator(false);
+    }
+  } else if (code_index_number == 0x9) {
     // note on
     const uint8_t velocity = event_packet[3] & 0x7f;
-    const uint8_t prev_velocity = note_status->velocity;
-    note_status->velocity = velocity;
-    add_to_osc_status(pitch, velocity - prev_velocity);
-    gpio_put(_gpio_pin_activity_indicator, velocity > 0 ? 1 : 0);
+    if (velocity) {
+      set_note_velocity(channel, pitch, velocity);
+    } else {
+      note_off(channel, pitch);
+    }
+    if (_activity_indicator) {
+      _activity_indicator(velocity > 0);
+    }
   } else if (code_index_number == 0x8) {
     // note off
-    const uint8_t velocity = note_status->velocity;
-    note_status->velocity = 0;
-    add_to_osc_status(pitch, -velocity);
-    gpio_put(_gpio_pin_activity_indicator, 0);
+    note_off(channel, pitch);
+    if (_activity_indicator) {
+      _activity_indicator(false);
+    }
+  } else if (code_index_number == 0xa) {
+    // polyphonic key pressure: no per note parameter to apply it to
+  } else if (code_index_number == 0xb) {
+    // control change (all MSB only) or channel mode message
+    const uint8_t controller = event_packet[2] & 0x7f;
+    const uint8_t value = event_packet[3] & 0x7f;
+    control_change(channel, controller, value);
+  } else if (code_index_number == 0xc) {
+    // program change: just kept, as there is a single timbre
+    _midi_status.channel_status[channel].program = event_packet[2] & 0x7f;
+  } else if (code_index_number == 0xd) {
+    // channel pressure
+    _midi_status.channel_status[channel].pressure = event_packet[2] & 0x7f;
+  } else if (code_index_number == 0xe) {
+    // pitch bend
+    _midi_status.channel_status[channel].bend =
+      ((event_packet[3] & 0x7f) << 7) | (event_packet[2] & 0x7f);
+    update_channel_bend(channel);
   }
 }
 
+/*
+ * Once the event queue is enabled, the oscillators and the MIDI state
+ * are owned by the consumer of the queue (usually the audio rendering
+ * core), and event packets from any other source must go through
+ * post_event_packet() rather than consume_event_packet().
+ */
+void
+MIDI_state_machine::enable_event_queue()
+{
+  _event_queue_enabled = true;
+}
+
 void
-MIDI_state_machine::rx_task()
+MIDI_state_machine::post_event_packet(const uint8_t *event_packet,
+                                      const uint64_t sample_time)
 {
-  tud_task();
-  if (!tud_midi_mounted()) {
+  midi_event_t event;
+  event.sample_time = sample_time;
+  memcpy(event.packet, event_packet, sizeof(event.packet));
+  if (sample_time) {
+    _timed_event_post_count.store(
+      _timed_event_post_count.load(std::memory_order_relaxed) + 1,
+      std::memory_order_relaxed);
+  }
+  if (!_event_queue_enabled) {
+    if (sample_time) {
+      schedule_event(&event);
+    } else {
+      consume_event_packet(event_packet);
+    }
     return;
   }
-  while (tud_midi_available()) {
-    /*
-     * For the structure of the 4-byte packets, see "USB_MIDI Event
-     * Packets" in: USB device class definition
-     * (usb.org/sites/default/files/midi10.pdf), page 16.
-     */
-    uint8_t event_packet[4];
-    if (tud_midi_packet_read(event_packet)) {
-      consume_event_packet(&event_packet[0]);
+  /*
+   * The producer also services USB and the network, so a stalled
+   * consumer must not hang it for good: when the queue stays full,
+   * drop the event, unless it is a note off, which would leave the
+   * note sounding forever.
+   */
+  uint32_t spins = 0;
+  while (!_event_queue.push(event)) {
+    if ((++spins >= POST_WAIT_SPINS) && !is_note_off(event_packet)) {
+      if (sample_time) {
+        _timed_event_post_count.store(
+          _timed_event_post_count.load(std::memory_order_relaxed) - 1,
+          std::memory_order_relaxed);
+      }
+      _dropped_event_count++;
+      return;
     }
+    tight_loop_contents();
   }
 }
 
+bool
+MIDI_state_machine::is_note_off(const uint8_t *event_packet)
+{
+  const uint8_t code_index_number = event_packet[0] & 0xf;
+  return
+    (code_index_number == 0x8) ||
+    ((code_index_number == 0x9) && !(event_packet[3] & 0x7f));
+}
+
+/*
+ * Whether a timed event posted now is sure to find room in the pending
+ * list.  Producers that post far ahead of time, such as the network
+ * source, hold back further events while this is false.  Called by the
+ * producer only, such that it just reads what the consumer counts.
+ */
+bool
+MIDI_state_machine::can_schedule_event() const
+{
+  return _timed_event_post_count.load(std::memory_order_relaxed) -
+    _timed_event_apply_count.load(std::memory_order_acquire) <
+    PENDING_EVENTS_SIZE;
+}
+
 void
-MIDI_state_machine::produce_tx_data(uint8_t *buffer,
-                                    __unused const size_t max_buffer_size,
-                                    size_t *const buffer_size)
+MIDI_state_machine::count_timed_event_applied()
 {
-  /* when deadline for next active sensing has expired, produce a
-     packet containing a sensive acting MIDI code */
-  const uint64_t timestamp_now = time_us_64();
-  if (timestamp_now - _timestamp_active_sensing > 300000) {
-    _timestamp_active_sensing += 300000;
-    buffer[0] = 0xFE; // MIDI code for active sensing
-    *buffer_size = 1;
-  } else {
-    *buffer_size = 0;
-  }
+  _timed_event_apply_count.store(
+    _timed_event_apply_count.load(std::memory_order_relaxed) + 1,
+    std::memory_order_release);
 }
 
+/*
+ * Pending events are kept sorted by descending sample time, such that
+ * the next due event is always the last one.  Events with equal
+ * sample time are applied in the order they were posted.  If the
+ * list is full nevertheless, as producers not checking
+ * can_schedule_event() may overfill it, the earliest event is applied
+ * ahead of time rather than dropped.
+ */
 void
-MIDI_state_machine::tx_task()
+MIDI_state_machine::schedule_event(const midi_event_t *event)
 {
-  static uint8_t tx_data_buffer[3];
-  size_t buffer_size;
-  produce_tx_data(tx_data_buffer, sizeof(tx_data_buffer), &buffer_size);
-  tud_midi_stream_write(0, tx_data_buffer, buffer_size);
+  if (_pending_event_count == PENDING_EVENTS_SIZE) {
+    consume_event_packet(&_pending_events[--_pending_event_count].packet[0]);
+    count_timed_event_applied();
+  }
+  size_t index = _pending_event_count;
+  while (index &&
+         (_pending_events[index - 1].sample_time <= event->sample_time)) {
+    _pending_events[index] = _pending_events[index - 1];
+    index--;
+  }
+  _pending_events[index] = *event;
+  _pending_event_count++;
+}
+
+/*
+ * Apply all posted events that are due up to and including the given
+ * sample time, and return the sample time of the next pending event,
+ * or NO_PENDING_EVENT.  The renderer calls this right before each
+ * span of samples it renders, such that events take effect on the
+ * exact sample.  Events posted without sample time would be due
+ * before any pending one, hence they are applied right away rather
+ * than taking room in the pending list.
+ */
+uint64_t
+MIDI_state_machine::consume_posted_events(const uint64_t sample_time)
+{
+  midi_event_t event;
+  while (_event_queue.pop(&event)) {
+    if (event.sample_time) {
+      schedule_event(&event);
+    } else {
+      consume_event_packet(&event.packet[0]);
+    }
+  }
+  while (_pending_event_count) {
+    midi_event_t *next_event = &_pending_events[_pending_event_count - 1];
+    if (next_event->sample_time > sample_time) {
+      return next_event->sample_time;
+    }
+    consume_event_packet(&next_event->packet[0]);
+    _pending_event_count--;
+    count_timed_event_applied();
+  }
+  return NO_PENDING_EVENT;
 }
 
 /*
@@ -33,55 +33,315 @@
 #ifndef MIDI_STATE_MACHINE_HPP
 #define MIDI_STATE_MACHINE_HPP
 
-#include <ctime>
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include <functional>
+#include "percussion-bank.hpp"
+#include "spsc-ring.hpp"
 
 class MIDI_state_machine {
 public:
   static const size_t NUM_OSC = 0x80;
   static const size_t NUM_CHN = 0x10;
+#ifdef USE_DDS_OSC
+  /*
+   * Phase accumulator (DDS) oscillator: phase advances by phase_inc
+   * per sample and wraps at 2^32; the pulse is negative while the
+   * phase is at or above pulse_width (2^31 for a square wave), the
+   * elongations hold the (non-negative) magnitudes of the left and
+   * right channel.
+   */
+  typedef struct {
+    uint32_t phase_inc;
+    uint32_t phase;
+    uint32_t pulse_width;
+    uint16_t velocity;
+    int16_t elongation_left;
+    int16_t elongation_right;
+  } osc_status_t;
+  typedef struct {
+    uint32_t phase_inc[NUM_OSC];
+    uint32_t phase[NUM_OSC];
+    uint32_t pulse_width[NUM_OSC];
+    int16_t elongation_left[NUM_OSC];
+    int16_t elongation_right[NUM_OSC];
+    uint16_t velocity[NUM_OSC];
+  } osc_bank_t;
+#else
+  /*
+   * Both elongations always carry the same sign; each is the sum of
+   * the panned, enveloped velocities of all voices playing the
+   * oscillator's note, but not both 0 while any voice plays it, such
+   * that the sign is kept.  The pulse toggles whenever count crosses
+   * count_wrap, which then swaps with count_wrap_next, such that
+   * both halves of a period may differ in length (equal for a square
+   * wave).
+   */
   typedef struct {
     uint32_t count_wrap;
+    uint32_t count_wrap_next;
     uint32_t count;
     uint16_t velocity;
-    int16_t elongation;
+    int16_t elongation_left;
+    int16_t elongation_right;
   } osc_status_t;
+  /*
+   * The oscillator bank keeps each field of all oscillators in a
+   * dense array of its own, such that the render loops stream just
+   * the fields they need, and velocity (only needed for note events)
+   * stays out of their way.  With the RP2040's word striped SRAM,
+   * consecutive words of each array rotate through all four banks.
+   */
   typedef struct {
-    uint8_t velocity;
-  } note_status_t;
+    uint32_t count_wrap[NUM_OSC];
+    uint32_t count_wrap_next[NUM_OSC];
+    uint32_t count[NUM_OSC];
+    int16_t elongation_left[NUM_OSC];
+    int16_t elongation_right[NUM_OSC];
+    uint16_t velocity[NUM_OSC];
+  } osc_bank_t;
+#endif
+  static_assert(!(NUM_OSC & 0x7),
+                "oscillator arrays must cover whole stripes of all banks");
+  static const size_t NUM_VOICES = 0x80;
+  static const uint8_t NO_VOICE = 0xff;
+  static_assert(NUM_VOICES <= NO_VOICE, "voice index must fit into uint8_t");
+  static const size_t NOTE_TABLE_SIZE = 2 * NUM_VOICES; // at most half full
+  static_assert(!(NOTE_TABLE_SIZE & (NOTE_TABLE_SIZE - 1)),
+                "note table size must be a power of two");
+  static const uint8_t NUM_CONTROLLERS = 0x78; // beyond: channel mode
+  /*
+   * All controllers of a channel are kept as their latest values
+   * (0..0x7f), such that each control change is just a store plus,
+   * for controllers the synth responds to, an update of the values
+   * derived from it: the gains from pan, volume and expression, the
+   * per tick level increments and the sustain level from the
+   * envelope controllers, and the duty cycle from pulse width and
+   * LFO.  Notes released while the hold pedal is down are marked in
+   * held_notes until the pedal goes up; notes with a voice, including
+   * those fading out, are marked in sounding_notes.  The voice of a
+   * sounding note is found via the note table rather than kept for
+   * each of the 128 notes.
+   */
   typedef struct {
-    note_status_t note_status[NUM_OSC];
+    uint8_t controllers[NUM_CONTROLLERS];
+    uint32_t held_notes[NUM_OSC / 32]; // bit set, by pitch
+    uint32_t sounding_notes[NUM_OSC / 32]; // bit set, by pitch
+    uint16_t bend; // 0..0x3fff, PITCH_BEND_CENTER for none
+    int16_t pitch_bend; // bend in 1/256 semitones
+    uint8_t bend_range; // semitones, MIN_BEND_RANGE..MAX_BEND_RANGE
+    uint8_t last_pitch; // where the next glide starts, or NO_PITCH
+    uint8_t program;
+    uint8_t pressure; // channel pressure (aftertouch)
+    uint8_t gain_left; // 0..PAN_GAIN_UNITY
+    uint8_t gain_right; // 0..PAN_GAIN_UNITY
+    uint8_t duty; // current duty cycle, 0..DUTY_FULL
+    uint32_t attack_inc; // per envelope tick
+    uint32_t decay_inc; // per envelope tick
+    uint32_t release_inc; // per envelope tick
+    uint32_t sustain_level; // 0..ENV_LEVEL_FULL
+    uint32_t lfo_phase;
+    uint32_t lfo_phase_inc; // per LFO tick
+    uint32_t glide_recip; // 2^32 / portamento ticks, 0 for no glide
   } channel_status_t;
+  /*
+   * A voice is a note sounding on one channel, including its release
+   * after the key went up.  Its elongations are the amounts it
+   * currently contributes to the elongations of its oscillator.
+   * While gliding, glide is the remaining distance from the voice's
+   * own pitch, in 2^-GLIDE_FRACTION_BITS semitones.
+   */
+  typedef struct {
+    uint32_t level; // 0..ENV_LEVEL_FULL
+    uint32_t serial; // note on order
+    int32_t glide;
+    int32_t glide_step; // per envelope tick
+    int16_t elongation_left;
+    int16_t elongation_right;
+    uint8_t channel;
+    uint8_t pitch;
+    uint8_t velocity;
+    uint8_t stage;
+  } voice_t;
   typedef struct {
     channel_status_t channel_status[NUM_CHN];
   } midi_status_t;
-  static const uint32_t COUNT_INC;
+  static const size_t EVENT_QUEUE_SIZE = 0x100;
+  static const size_t PENDING_EVENTS_SIZE = 0x80;
+  // how long to wait for room in a full event queue before dropping
+  static const uint32_t POST_WAIT_SPINS = 0x100000;
+  static const uint64_t NO_PENDING_EVENT = UINT64_MAX;
+  /*
+   * sample_time is the absolute index of the output sample at which
+   * the event takes effect; 0 applies it as soon as possible.
+   */
+  typedef struct {
+    uint64_t sample_time;
+    uint8_t packet[4];
+  } midi_event_t;
+  static const uint8_t COUNT_HEADROOM_BITS = 0x8;
+  static const uint32_t COUNT_INC = ((uint32_t)1u) << COUNT_HEADROOM_BITS;
+  static const uint8_t PAN_CENTER = 0x40;
+  static const uint8_t PAN_GAIN_BITS = 7;
+  static const uint8_t PAN_GAIN_UNITY = 1u << PAN_GAIN_BITS;
+  static const uint8_t PERCUSSION_CHANNEL = 0x9; // GM channel 10
+  static const uint8_t CONTROLLER_MODULATION = 0x01;
+  static const uint8_t CONTROLLER_PORTAMENTO_TIME = 0x05;
+  static const uint8_t CONTROLLER_DATA_ENTRY = 0x06;
+  static const uint8_t CONTROLLER_VOLUME = 0x07;
+  static const uint8_t CONTROLLER_PAN = 0x0a;
+  static const uint8_t CONTROLLER_EXPRESSION = 0x0b;
+  static const uint8_t CONTROLLER_HOLD = 0x40;
+  static const uint8_t CONTROLLER_PORTAMENTO = 0x41;
+  static const uint8_t CONTROLLER_PULSE_WIDTH = 0x46;
+  static const uint8_t CONTROLLER_RELEASE = 0x48;
+  static const uint8_t CONTROLLER_ATTACK = 0x49;
+  static const uint8_t CONTROLLER_DECAY = 0x4b;
+  static const uint8_t CONTROLLER_LFO_RATE = 0x4c;
+  static const uint8_t CONTROLLER_SUSTAIN = 0x4f;
+  static const uint8_t CONTROLLER_ALL_SOUND_OFF = 0x78; // channel mode
+  static const uint8_t CONTROLLER_RESET_ALL = 0x79; // channel mode
+  static const uint8_t CONTROLLER_ALL_NOTES_OFF = 0x7b; // channel mode
+  static const uint8_t DEFAULT_VOLUME = 0x7f;
+  static const uint8_t DEFAULT_EXPRESSION = 0x7f;
+  static const uint8_t HOLD_ON = 0x40; // and above
+  static const uint16_t PITCH_BEND_CENTER = 0x2000;
+  static const uint8_t DEFAULT_BEND_RANGE = 2;
+  static const uint8_t MIN_BEND_RANGE = 2;
+  static const uint8_t MAX_BEND_RANGE = 24;
+  static const uint8_t NO_PITCH = 0xff;
+  static const uint8_t GLIDE_FRACTION_BITS = 16;
+  static const uint8_t PULSE_WIDTH_SQUARE = 0x40;
+  static const uint8_t DEFAULT_LFO_RATE = 0x40; // ~0.9Hz
+  static const uint8_t DUTY_BITS = 8;
+  static const uint16_t DUTY_FULL = 1u << DUTY_BITS;
+  static const uint8_t DUTY_MIN = 0x0c; // ~5%
+  static const uint8_t DUTY_MAX = DUTY_FULL - DUTY_MIN;
+  static const uint8_t DEFAULT_ATTACK = 0x0a; // 2ms
+  static const uint8_t DEFAULT_DECAY = 0x50; // 256ms
+  static const uint8_t DEFAULT_SUSTAIN = 0x7f;
+  static const uint8_t DEFAULT_RELEASE = 0x32; // 32ms
+  static const uint8_t ENV_LEVEL_BITS = 24;
+  static const uint32_t ENV_LEVEL_FULL = ((uint32_t)1u) << ENV_LEVEL_BITS;
+  static const uint8_t ENV_GAIN_BITS = 15;
+  static const uint32_t ENVELOPE_TICK_FRAMES = 32;
+  static_assert(!(ENVELOPE_TICK_FRAMES & (ENVELOPE_TICK_FRAMES - 1)),
+                "envelope tick must be a power of two");
+  static_assert(ENVELOPE_TICK_FRAMES == Percussion_bank::TICK_FRAMES,
+                "percussion decays on the envelope ticks");
+  static const uint32_t LFO_TICK_FRAMES = 256;
+  static_assert(!(LFO_TICK_FRAMES & (LFO_TICK_FRAMES - 1)),
+                "LFO tick must be a power of two");
+  static const uint8_t ENV_ATTACK = 0;
+  static const uint8_t ENV_DECAY = 1;
+  static const uint8_t ENV_SUSTAIN = 2;
+  static const uint8_t ENV_RELEASE = 3;
+  typedef std::function<void(const bool active)> activity_indicator_t;
   MIDI_state_machine();
   virtual ~MIDI_state_machine();
-  void init(const uint32_t sample_freq,
-            const uint8_t gpio_pin_activity_indicator);
-  osc_status_t *get_osc_statuses();
-  void rx_task();
-  void tx_task();
+  bool init(const uint32_t sample_freq);
+  bool set_sample_freq(const uint32_t sample_freq);
+  void set_activity_indicator(const activity_indicator_t activity_indicator);
+  osc_bank_t *get_osc_bank();
+  Percussion_bank *get_percussion_bank();
+  void get_osc_statuses(osc_status_t *osc_statuses) const;
+  const uint8_t *get_active_oscs() const;
+  size_t get_active_osc_count() const;
+  const channel_status_t *get_channel_status(const uint8_t channel) const;
+  uint8_t get_note_velocity(const uint8_t channel, const uint8_t pitch) const;
+  void control_change(const uint8_t channel, const uint8_t controller,
+                      const uint8_t value);
+  void all_notes_off(const uint8_t channel);
+  void all_sound_off(const uint8_t channel);
+  void reset_controllers(const uint8_t channel);
+  void reset();
+  size_t get_voice_count() const;
+  void set_voice_limit(const size_t voice_limit);
+  size_t get_voice_limit() const;
+  uint32_t get_stolen_voice_count() const;
+  uint32_t get_dropped_event_count() const;
+  bool has_ramping_voices() const;
+  void update_envelopes();
+  bool has_lfo_modulation() const;
+  void update_lfos();
   void consume_event_packet(const uint8_t *event_packet);
+  void enable_event_queue();
+  void post_event_packet(const uint8_t *event_packet,
+                         const uint64_t sample_time = 0);
+  bool can_schedule_event() const;
+  uint64_t consume_posted_events(const uint64_t sample_time);
 private:
-  static const double OCTAVE_FREQ_RATIO;
-  static const uint8_t NOTES_PER_OCTAVE;
-  static const double A4_FREQ; // freqency of concert pitch [Hz]
-  static const uint8_t A4_NOTE_NUMBER; // MIDI note number of concert pitch
-  static const uint8_t COUNT_HEADROOM_BITS;
-  uint8_t _gpio_pin_activity_indicator;
-  osc_status_t _osc_statuses[NUM_OSC];
+  activity_indicator_t _activity_indicator;
+  const uint32_t *_osc_table = nullptr; // per-note wrap or increment
+  alignas(16) osc_bank_t _osc_bank;
+  uint8_t _active_oscs[NUM_OSC]; // oscs with at least one voice
+  uint8_t _active_osc_index[NUM_OSC]; // position of osc in _active_oscs
+  size_t _active_osc_count = 0;
   midi_status_t _midi_status;
-  uint8_t _skip_count = 0;
-  uint8_t _msg_count = 0;
-  uint64_t _timestamp_active_sensing;
-  void osc_init(const uint32_t sample_freq);
+  Percussion_bank _percussion_bank;
+  uint32_t _sample_freq = 0;
+  voice_t _voices[NUM_VOICES]; // dense, in no particular order
+  uint8_t _note_voices[NOTE_TABLE_SIZE]; // by channel and pitch, or NO_VOICE
+  size_t _voice_count = 0;
+  size_t _voice_limit = NUM_VOICES;
+  uint32_t _voice_serial = 0;
+  uint32_t _stolen_voice_count = 0;
+  bool _ramping = false; // whether any voice is not sustaining
+  uint16_t _lfo_channels = 0; // bit mask of channels with active LFO
+  uint8_t _osc_duty[NUM_OSC]; // duty cycle of each oscillator
+  uint8_t _osc_channel[NUM_OSC]; // channel of the latest voice started
+  int16_t _osc_pitch[NUM_OSC]; // in 1/256 semitones
+  uint32_t _osc_rate[NUM_OSC]; // table value for _osc_pitch
+#ifndef USE_DDS_OSC
+  int16_t _osc_magnitude_left[NUM_OSC]; // sum of the voices' elongations
+  int16_t _osc_magnitude_right[NUM_OSC]; // sum of the voices' elongations
+#endif
+  bool _gliding = false; // whether any voice is gliding
+  uint16_t _retune_channels = 0; // bit mask of channels with new bend
+  bool _event_queue_enabled = false;
+  SPSC_ring<midi_event_t, EVENT_QUEUE_SIZE> _event_queue;
+  midi_event_t _pending_events[PENDING_EVENTS_SIZE]; // latest first
+  size_t _pending_event_count = 0;
+  // timed events posted (by the producer) and applied (by the consumer)
+  std::atomic<uint32_t> _timed_event_post_count{0};
+  std::atomic<uint32_t> _timed_event_apply_count{0};
+  uint32_t _dropped_event_count = 0; // events not posted for a full queue
+  bool osc_init(const uint32_t sample_freq);
   void state_init();
-  void led_init(const uint8_t gpio_pin_activity_indicator);
-  void add_to_osc_status(const uint8_t pitch, const int8_t delta_velocity);
-  void produce_tx_data(uint8_t *buffer,
-                       __unused const size_t max_buffer_size,
-                       size_t *const buffer_size);
+  void activate_osc(const uint8_t osc);
+  size_t find_note_slot(const uint8_t channel, const uint8_t pitch) const;
+  uint8_t find_note_voice(const uint8_t channel, const uint8_t pitch) const;
+  void remove_note_slot(size_t slot);
+  void deactivate_osc(const uint8_t osc);
+#ifndef USE_DDS_OSC
+  int16_t get_osc_sign(const uint8_t osc) const;
+#endif
+  void add_to_osc_status(const uint8_t pitch, const int8_t delta_velocity,
+                         const int16_t delta_left, const int16_t delta_right);
+  void note_off(const uint8_t channel, const uint8_t pitch);
+  void set_note_velocity(const uint8_t channel, const uint8_t pitch,
+                         const uint8_t velocity);
+  void update_envelope_incs(channel_status_t *channel_status);
+  void update_channel_gains(const uint8_t channel);
+  void set_channel_hold(const uint8_t channel, const bool hold);
+  uint8_t alloc_voice(const uint8_t channel, const uint8_t pitch);
+  void free_voice(const uint8_t voice);
+  void steal_voice();
+  bool step_envelope(voice_t *voice);
+  void update_voice_elongations(voice_t *voice);
+  void update_lfo_inc(channel_status_t *channel_status);
+  void update_channel_duty(const uint8_t channel);
+  void set_osc_duty(const uint8_t osc, const uint8_t duty);
+  void retune_osc(const uint8_t osc, const int32_t pitch);
+  void update_voice_pitch(const voice_t *voice);
+  void update_channel_bend(const uint8_t channel);
+  void retune_channel(const uint8_t channel);
+  void update_glide_recip(channel_status_t *channel_status);
+  void start_glide(voice_t *voice);
+  void schedule_event(const midi_event_t *event);
+  void count_timed_event_applied();
+  static bool is_note_off(const uint8_t *event_packet);
 };
 
 #endif /* MIDI_STATE_MACHINE_HPP */
@@ -0,0 +1,194 @@
+/*
+ * Mix Bus of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#include "mix-bus.hpp"
+#include <array>
+#include "const-math.hpp"
+#include "midi-state-machine.hpp"
+
+const uint8_t
+Mix_bus::VOL_BITS;
+
+const uint16_t
+Mix_bus::VOL_MUL;
+
+const int32_t
+Mix_bus::FULL_SCALE;
+
+const int32_t
+Mix_bus::KNEE;
+
+/*
+ * Each oscillator's elongation is the sum of the panned velocities of
+ * all channels playing its note, such that the worst case mix is all
+ * oscillators at full velocity on all channels, plus all drum voices
+ * at full velocity.  Accumulating and scaling that in int32 must not
+ * overflow, even for the mono sum of both sides.
+ */
+static constexpr int64_t MAX_ELONGATION = 0x7f * MIDI_state_machine::NUM_CHN;
+static constexpr int64_t MAX_DRUM_ELONGATION =
+  0x7f * Percussion_bank::NUM_VOICES;
+static constexpr int64_t MAX_MIX =
+  2 * (MAX_ELONGATION * MIDI_state_machine::NUM_OSC + MAX_DRUM_ELONGATION) *
+  Mix_bus::VOL_MUL;
+static_assert(MAX_MIX <= INT32_MAX, "mix bus lacks headroom for int32");
+
+/*
+ * Above the knee, the limiter follows knee + h * tanh(x / h), with h
+ * being the distance from knee to full scale, such that the slope is
+ * continuous at the knee and the output approaches full scale
+ * asymptotically.  The table covers inputs up to 4 h above the knee
+ * (tanh(4) ~ 0.9993) and is linearly interpolated; anything beyond
+ * is saturated and counted as clipped.
+ */
+static constexpr int32_t LIMITER_HEADROOM = Mix_bus::FULL_SCALE - Mix_bus::KNEE;
+static constexpr uint8_t LIMITER_LUT_BITS = 8;
+static constexpr uint8_t LIMITER_STEP_BITS = 7;
+static constexpr int32_t LIMITER_RANGE =
+  ((int32_t)1) << (LIMITER_LUT_BITS + LIMITER_STEP_BITS);
+static_assert(LIMITER_RANGE >= 4 * LIMITER_HEADROOM,
+              "limiter table too short for tanh() to settle");
+
+typedef std::array<int16_t, (1u << LIMITER_LUT_BITS) + 1> limiter_lut_t;
+
+static constexpr limiter_lut_t
+make_limiter_lut()
+{
+  limiter_lut_t lut{};
+  for (size_t index = 0; index < lut.size(); index++) {
+    const double x = (double)(index << LIMITER_STEP_BITS) / LIMITER_HEADROOM;
+    lut[index] = Mix_bus::KNEE + const_round(LIMITER_HEADROOM * const_tanh(x));
+  }
+  return lut;
+}
+
+static constexpr limiter_lut_t LIMITER_LUT = make_limiter_lut();
+
+Mix_bus::Mix_bus()
+{
+  reset_meters();
+}
+
+Mix_bus::~Mix_bus()
+{
+}
+
+void
+Mix_bus::reset_meters()
+{
+  _meters.peak = 0;
+  _meters.limited_sample_count = 0;
+  _meters.clipped_sample_count = 0;
+}
+
+const Mix_bus::meters_t *
+Mix_bus::get_meters() const
+{
+  return &_meters;
+}
+
+uint32_t
+Mix_bus::get_total_clipped_sample_count() const
+{
+  return _total_clipped_sample_count;
+}
+
+/*
+ * The meters are passed in as locals of the caller, such that they
+ * can live in registers rather than possibly aliasing the output.
+ */
+static inline int16_t
+limit(const int32_t mix_value, uint32_t *peak,
+      uint16_t *limited_sample_count, uint16_t *clipped_sample_count)
+{
+  const int32_t sample_value =
+    (mix_value * Mix_bus::VOL_MUL) >> Mix_bus::VOL_BITS;
+  const int32_t sign = sample_value >> 31;
+  int32_t magnitude = (sample_value ^ sign) - sign;
+  if ((uint32_t)magnitude > *peak) {
+    *peak = magnitude;
+  }
+  if (magnitude > Mix_bus::KNEE) {
+    const int32_t excess = magnitude - Mix_bus::KNEE;
+    if (excess >= LIMITER_RANGE) {
+      magnitude = Mix_bus::FULL_SCALE;
+      (*clipped_sample_count)++;
+    } else {
+      const int32_t index = excess >> LIMITER_STEP_BITS;
+      const int32_t fraction = excess & ((1 << LIMITER_STEP_BITS) - 1);
+      const int32_t base = LIMITER_LUT[index];
+      magnitude = base +
+        (((LIMITER_LUT[index + 1] - base) * fraction) >> LIMITER_STEP_BITS);
+      (*limited_sample_count)++;
+    }
+  }
+  return (int16_t)((magnitude ^ sign) - sign);
+}
+
+/*
+ * Mono output is the average of both sides, such that a centered
+ * channel sounds as loud as in stereo.
+ */
+void
+Mix_bus::write_out(const int32_t *mix_left, const int32_t *mix_right,
+                   int16_t *out, const uint32_t frame_count,
+                   const bool stereo)
+{
+  uint32_t peak = _meters.peak;
+  uint16_t limited_sample_count = 0;
+  uint16_t clipped_sample_count = 0;
+  if (stereo) {
+    for (uint32_t frame = 0; frame < frame_count; frame++) {
+      *out++ = limit(mix_left[frame], &peak, &limited_sample_count,
+                     &clipped_sample_count); // left channel
+      *out++ = limit(mix_right[frame], &peak, &limited_sample_count,
+                     &clipped_sample_count); // right channel
+    }
+  } else {
+    for (uint32_t frame = 0; frame < frame_count; frame++) {
+      *out++ = limit((mix_left[frame] + mix_right[frame]) >> 1, &peak,
+                     &limited_sample_count,
+                     &clipped_sample_count); // mono channel
+    }
+  }
+  _meters.peak = peak;
+  _meters.limited_sample_count += limited_sample_count;
+  _meters.clipped_sample_count += clipped_sample_count;
+  _total_clipped_sample_count += clipped_sample_count;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,75 @@
+/*
+ * Mix Bus of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#ifndef MIX_BUS_HPP
+#define MIX_BUS_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Final stage of the synthesizer: applies the master volume to the
+ * int32 sums of all oscillators for the left and right channel,
+ * passes them through a soft-knee limiter and saturates the result to
+ * signed 16 bit samples, while metering each buffer.
+ */
+class Mix_bus {
+public:
+  typedef struct {
+    uint32_t peak; // largest magnitude before limiting
+    uint16_t limited_sample_count; // samples within the soft knee
+    uint16_t clipped_sample_count; // samples saturated to full scale
+  } meters_t;
+  static const uint8_t VOL_BITS = 8;
+  static const uint16_t VOL_MUL = 2u << VOL_BITS; // volume 2.0
+  static const int32_t FULL_SCALE = 0x7fff;
+  static const int32_t KNEE = 0x6000; // limiter threshold, about -2.5 dBFS
+  Mix_bus();
+  virtual ~Mix_bus();
+  void write_out(const int32_t *mix_left, const int32_t *mix_right,
+                 int16_t *out, const uint32_t frame_count, const bool stereo);
+  void reset_meters();
+  const meters_t *get_meters() const;
+  uint32_t get_total_clipped_sample_count() const;
+private:
+  meters_t _meters;
+  uint32_t _total_clipped_sample_count = 0;
+};
+
+#endif /* MIX_BUS_HPP */
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -5,6 +5,8 @@
 #include <wifi-stuff.hpp>
 #include <display.h>
 #include <stdio.h>
+#include <string.h>
+#include <inttypes.h>
 #include <ntp.hpp>
 #include <tlv.h>
 #include "led.h"
@@ -80,9 +82,8 @@ Network_source::Network_source(MIDI_state_machine *const midi_state_machine) :
   }
 
   memset(&note_buffer, 0, sizeof(note_buffer));
-  uint64_t uniq_id;
-  pico_get_unique_board_id((pico_unique_board_id_t *)(&uniq_id));
-  printf("uniq id: 0x%llx\n", uniq_id);
+  pico_get_unique_board_id((pico_unique_board_id_t *)(&_board_id));
+  printf("uniq id: 0x%" PRIx64 "\n", _board_id);
 }
 
 Network_source::~Network_source()
@@ -95,6 +96,23 @@ void Network_source::set_ntp(NTP_client *const ntp)
   _ntp = ntp;
 }
 
+void Network_source::set_sample_clock(Sample_clock *const sample_clock)
+{
+  _sample_clock = sample_clock;
+}
+
+// Replace the unique board id that pan and envelope packets are
+// matched against, e.g. to render a capture as one particular node.
+void Network_source::set_board_id(const uint64_t board_id)
+{
+  _board_id = board_id;
+}
+
+void Network_source::set_tlv_callback(uint8_t type, TLV_registry::callback_func func)
+{
+  _tlv_reg.set_callback(type, func);
+}
+
 void Network_source::rx_task()
 {
     while (udp_buffer.count > 0) {
@@ -111,84 +129,110 @@ void Network_source::rx_task()
     play_note();
 }
 
+// With a sample clock, notes are posted to the renderer ahead of time
+// and start on the exact output sample of their timestamp.  Must
+// exceed the latency of the audio buffer pool (8 x 256 samples).
+#define SCHEDULE_AHEAD_US 125000
+
+// Notes are posted ahead of time as long as the synth has room to
+// schedule them, while the display and the LEDs follow each note only
+// once its time has come, such that they stay in step with the audio.
 void Network_source::play_note()
 {
   uint64_t now = _ntp->powerup_time + get_absolute_time();
-  if (note_buffer.count > 0)
+  uint64_t horizon = _sample_clock ? now + SCHEDULE_AHEAD_US : now;
+  while ((note_buffer.scheduled < note_buffer.count) &&
+         _midi_state_machine->can_schedule_event())
   {
-    while ((note_buffer.note[note_buffer.head].us_since_1900 < now ) &&
-          ( note_buffer.count > 0 ))
+    tlv_type_note_t *p = &(note_buffer.note[(note_buffer.head + note_buffer.scheduled) % NOTE_BUFFER_SIZE]);
+    if (p->us_since_1900 >= horizon)
     {
-      //printf("%llu < %llu\n", note_buffer.note[note_buffer.head].us_since_1900, now);
-
-      tlv_type_note_t *p = &(note_buffer.note[note_buffer.head]);
-
-      printf("playing note %s%d o%s %lld ms late\n",
-              note_name[p->note%12], p->note/12-1,
-              p->onoff ? "n" : "ff",
-              (now  - note_buffer.note[note_buffer.head].us_since_1900) / 1000LL);
+      break;
+    }
+    schedule_note(p, now);
+    note_buffer.scheduled++;
+  }
+  while ((note_buffer.scheduled > 0) &&
+         (note_buffer.note[note_buffer.head].us_since_1900 < now))
+  {
+    show_note(&(note_buffer.note[note_buffer.head]));
+    note_buffer.head = (note_buffer.head + 1) % NOTE_BUFFER_SIZE;
+    note_buffer.count--;
+    note_buffer.scheduled--;
+  }
+}
 
-      uint8_t packet[4];
-      if (p->onoff == 1)
-      {
-        packet[0] = 0x09;  // note on
+void Network_source::schedule_note(tlv_type_note_t *p, uint64_t now)
+{
+  int64_t lead_ms = ((int64_t)p->us_since_1900 - (int64_t)now) / 1000;
+  printf("playing note %s%d o%s %" PRId64 " ms %s\n",
+         note_name[p->note%12], p->note/12-1,
+         p->onoff ? "n" : "ff",
+         lead_ms < 0 ? -lead_ms : lead_ms, lead_ms < 0 ? "late" : "early");
 
-        scroll_down(8);
-        char str_note[6];
-        snprintf(str_note, 6, "%s%d", note_name[p->note%12], p->note/12-1);
-        write_string(2, 0, str_note);
+  uint64_t sample_time = 0;
+  if (_sample_clock)
+  {
+    sample_time = _sample_clock->to_sample_time(p->us_since_1900 - _ntp->powerup_time);
+  }
 
-        draw_rect(32, 0, SSD1306_WIDTH-1, SSD1306_HEIGHT-1, false);
+  uint8_t packet[4];
+  packet[0] = p->onoff == 1 ? 0x09 : 0x08;  // note on or off
+  packet[1] = p->channel; // channel
+  packet[2] = p->note;
+  packet[3] = p->velocity;
 
-        int yy = 0;
-        write_string(32, yy, _artist);
-        if (strlen(_artist) > 16)
-        {
-          yy += 8;
-          write_string(32, yy, _artist+16);
-        }
-        if (strlen(_artist) > 32)
-        {
-          yy += 8;
-          write_string(32, yy, _artist+32);
-        }
-        yy += 8;
-        write_string(32, yy, _title);
-        if (strlen(_title) > 16)
-        {
-          yy += 8;
-          write_string(32, yy, _title+16);
-        }
-        if (strlen(_title) > 32)
-        {
-          yy += 8;
-          write_string(32, yy, _title+32);
-        }
-        if (strlen(_title) > 48)
-        {
-          yy += 8;
-          write_string(32, yy, _title+48);
-        }
+  _midi_state_machine->post_event_packet(packet, sample_time);
+}
 
-        write_string(38, is_large_display()?56:24, "[" NICK "]");
-        render_full();
+void Network_source::show_note(tlv_type_note_t *p)
+{
+  if (p->onoff != 1)
+  {
+    return;
+  }
+  scroll_down(8);
+  char str_note[6];
+  snprintf(str_note, 6, "%s%d", note_name[p->note%12], p->note/12-1);
+  write_string(2, 0, str_note);
 
-        scroll_down_leds();
-        update_leds();
+  draw_rect(32, 0, SSD1306_WIDTH-1, SSD1306_HEIGHT-1, false);
 
-      }else{
-        packet[0] = 0x08;  // note off
-      }
-      packet[1] = p->channel; // channel
-      packet[2] = p->note;
-      packet[3] = p->velocity;
+  int yy = 0;
+  write_string(32, yy, _artist);
+  if (strlen(_artist) > 16)
+  {
+    yy += 8;
+    write_string(32, yy, _artist+16);
+  }
+  if (strlen(_artist) > 32)
+  {
+    yy += 8;
+    write_string(32, yy, _artist+32);
+  }
+  yy += 8;
+  write_string(32, yy, _title);
+  if (strlen(_title) > 16)
+  {
+    yy += 8;
+    write_string(32, yy, _title+16);
+  }
+  if (strlen(_title) > 32)
+  {
+    yy += 8;
+    write_string(32, yy, _title+32);
+  }
+  if (strlen(_title) > 48)
+  {
+    yy += 8;
+    write_string(32, yy, _title+48);
+  }
 
-      _midi_state_machine->consume_event_packet(packet);
+  write_string(38, is_large_display()?56:24, "[" NICK "]");
+  render_full();
 
-      note_buffer.head = (note_buffer.head + 1) % NOTE_BUFFER_SIZE;
-      note_buffer.count--;
-    }
-  }
+  scroll_down_leds();
+  update_leds();
 }
 
 void Network_source::tlv_time(tlv_packet_t *tp)
@@ -197,7 +241,7 @@ void Network_source::tlv_time(tlv_packet_t *tp)
 
   tlv_type_time_t *p = (tlv_type_time_t *)tp->payload;
   _ntp->powerup_time = p->us_since_1900 - get_absolute_time();
-  printf("his master's clock strikes %llu microseconds after 1900\n", p->us_since_1900);
+  printf("his master's clock strikes %" PRIu64 " microseconds after 1900\n", p->us_since_1900);
 }
 
 void Network_source::enqueue_note(tlv_packet_t *tp, uint8_t onoff)
@@ -216,6 +260,9 @@ void Network_source::enqueue_note(tlv_packet_t *tp, uint8_t onoff)
     if (note_buffer.count == NOTE_BUFFER_SIZE) {
         note_buffer.head = (note_buffer.head + 1) % NOTE_BUFFER_SIZE;
         note_buffer.count--;
+        if (note_buffer.scheduled > 0) {
+            note_buffer.scheduled--;
+        }
         printf("WARNING: dropping note, circular buffer is full\n");
     }
 
@@ -227,8 +274,9 @@ void Network_source::enqueue_note(tlv_packet_t *tp, uint8_t onoff)
         return;
     }
 
-    // binary search for the correct insertion point
-    uint16_t left = note_buffer.head;
+    // binary search for the correct insertion point; notes already
+    // posted to the synth stay put, such that a late note goes next
+    uint16_t left = (note_buffer.head + note_buffer.scheduled) % NOTE_BUFFER_SIZE;
     uint16_t right = note_buffer.tail;
     uint16_t insert_pos = left;
 
@@ -299,39 +347,100 @@ void Network_source::beat(tlv_packet_t *tp)
   tlv_type_beat_t *p = (tlv_type_beat_t *)tp->payload;
   if (p->count != last_count + 1)
   {
-    printf("WARNING: beat jumped from %ld to %ld\n", last_count, p->count);
+    printf("WARNING: beat jumped from %" PRIu32 " to %" PRIu32 "\n", last_count, p->count);
   }
   last_count = p->count;
-  printf("bpm %d, beat %ld, note_count %d\n", p->bpm, p->count, note_buffer.count);
+  printf("bpm %d, beat %" PRIu32 ", note_count %d\n", p->bpm, p->count, note_buffer.count);
 }
 
 void Network_source::start(tlv_packet_t *tp)
 {
   tlv_type_start_t *p = (tlv_type_start_t *)tp->payload;
-  printf("start will be at %llu us after 1900 with bpm %d, beat %ld\n", p->us_since_1900, p->bpm, p->count);
+  printf("start will be at %" PRIu64 " us after 1900 with bpm %d, beat %" PRIu32 "\n", p->us_since_1900, p->bpm, p->count);
   _start = p->us_since_1900;
   _bpm = p->bpm;
   _beat = p->count;
 }
 
+// Cut off all notes and reset all controllers of one channel, through
+// the event queue like any other MIDI input.
+void Network_source::reset_channel(uint8_t channel)
+{
+  uint8_t packet[4];
+  packet[0] = 0x0b;  // control change
+  packet[1] = 0xb0 | channel;
+  packet[3] = 0;
+  packet[2] = MIDI_state_machine::CONTROLLER_ALL_SOUND_OFF;
+  _midi_state_machine->post_event_packet(packet);
+  packet[2] = MIDI_state_machine::CONTROLLER_RESET_ALL;
+  _midi_state_machine->post_event_packet(packet);
+}
+
 void Network_source::panic(tlv_packet_t *tp)
 {
   (void)tp;
-  uint8_t packet[4];
-  packet[0] = 0x08;  // note off
-  packet[3] = 0;     // velocity
-  for (int i=0; i < 128; i++)
+  for (uint8_t c = 0; c < MIDI_state_machine::NUM_CHN; c++)
   {
-      packet[2] = i; // note
-      for (int c = 0; c<0x10; c++)
-      {
-        packet[1] = c;     // channel
-        _midi_state_machine->consume_event_packet(packet);
-      }
+    reset_channel(c);
   }
   printf("\n   ===   PANIC   ===\n\n");
 }
 
+void Network_source::channel_panic(tlv_packet_t *tp)
+{
+  tlv_type_channel_panic_t *p = (tlv_type_channel_panic_t *)tp->payload;
+  reset_channel(p->channel & 0xf);
+  printf("panic on channel %d\n", p->channel & 0xf);
+}
+
+// Post a control change for one MIDI channel (0x00..0x0f) or, for any
+// other channel value, all of them, such that it reaches the
+// oscillators the same way as MIDI input.
+void Network_source::post_control_change(uint8_t channel, uint8_t controller,
+                                         uint8_t value)
+{
+  for (uint8_t c = 0; c < MIDI_state_machine::NUM_CHN; c++)
+  {
+    if ((channel < MIDI_state_machine::NUM_CHN) && (channel != c))
+    {
+      continue;
+    }
+    const uint8_t packet[4] = {
+      0x0b, (uint8_t)(0xb0 | c), controller, (uint8_t)(value & 0x7f)
+    };
+    _midi_state_machine->post_event_packet(packet);
+  }
+}
+
+void Network_source::pan(tlv_packet_t *tp)
+{
+  tlv_type_pan_t *p = (tlv_type_pan_t *)tp->payload;
+  if (p->board_id && (p->board_id != _board_id))
+  {
+    return; // addressed to another node
+  }
+  post_control_change(p->channel,
+                      MIDI_state_machine::CONTROLLER_PAN, p->pan);
+}
+
+// The envelope values are those of the respective MIDI controllers.
+void Network_source::envelope(tlv_packet_t *tp)
+{
+  tlv_type_envelope_t *p = (tlv_type_envelope_t *)tp->payload;
+  if (p->board_id && (p->board_id != _board_id))
+  {
+    return; // addressed to another node
+  }
+  post_control_change(p->channel,
+                      MIDI_state_machine::CONTROLLER_ATTACK, p->attack);
+  post_control_change(p->channel,
+                      MIDI_state_machine::CONTROLLER_DECAY, p->decay);
+  post_control_change(p->channel,
+                      MIDI_state_machine::CONTROLLER_SUSTAIN, p->sustain);
+  post_control_change(p->channel,
+                      MIDI_state_machine::CONTROLLER_RELEASE, p->release);
+}
+
 void Network_source::scale(tlv_packet_t *tp)
 {
    // FIXME these need to go through the FIFO too, just as notes
@@ -764,8 +873,11 @@ void Network_source::init_tlv(TLV_registry& registry) {
     registry.set_callback(TLV_TYPE_BEAT, [this](tlv_packet_t *p) { this->beat(p); });
     registry.set_callback(TLV_TYPE_START, [this](tlv_packet_t *p) { this->start(p); });
     registry.set_callback(TLV_TYPE_PANIC, [this](tlv_packet_t *p) { this->panic(p); });
+    registry.set_callback(TLV_TYPE_CHANNEL_PANIC, [this](tlv_packet_t *p) { this->channel_panic(p); });
     registry.set_callback(TLV_TYPE_SCALE, [this](tlv_packet_t *p) { this->scale(p); });
     registry.set_callback(TLV_TYPE_CHORD, [this](tlv_packet_t *p) { this->chord(p); });
     registry.set_callback(TLV_TYPE_ARTIST, [this](tlv_packet_t *p) { this->artist(p); });
     registry.set_callback(TLV_TYPE_TITLE, [this](tlv_packet_t *p) { this->title(p); });
+    registry.set_callback(TLV_TYPE_PAN, [this](tlv_packet_t *p) { this->pan(p); });
+    registry.set_callback(TLV_TYPE_ENVELOPE, [this](tlv_packet_t *p) { this->envelope(p); });
 }
@@ -3,6 +3,7 @@
 #include <midi-state-machine.hpp>
 #include <TLV_registry.hpp>
 #include <ntp.hpp>
+#include <sample-clock.hpp>
 
 // TLV_TYPE_NOTE_ON or TLV_TYPE_NOTE_OFF
 typedef struct tlv_type_note_s
@@ -22,6 +23,7 @@ typedef struct {
     uint16_t head;
     uint16_t tail;
     uint16_t count;
+    uint16_t scheduled;  // notes from head on already posted to the synth
 } circular_note_buffer;
 
 class Network_source
@@ -32,12 +34,17 @@ public:
 
     void rx_task();
     void set_ntp(NTP_client *const ntp);
+    void set_sample_clock(Sample_clock *const sample_clock);
+    void set_board_id(const uint64_t board_id);
+    void set_tlv_callback(uint8_t type, TLV_registry::callback_func func);
 
     bool has_wifi;
 
 private:
     MIDI_state_machine *const _midi_state_machine;
     NTP_client *_ntp;
+    Sample_clock *_sample_clock = nullptr;
+    uint64_t _board_id;
     TLV_registry _tlv_reg;
     circular_note_buffer note_buffer;
 
@@ -57,6 +64,8 @@ private:
 
     void process_udp_data();
     void play_note();
+    void schedule_note(tlv_type_note_t *p, uint64_t now);
+    void show_note(tlv_type_note_t *p);
     void enqueue_note(tlv_packet_t *tp, uint8_t onoff);
 
     void tlv_time(tlv_packet_t *tp);
@@ -66,6 +75,12 @@ private:
     void beat(tlv_packet_t *tp);
     void start(tlv_packet_t *tp);
     void panic(tlv_packet_t *tp);
+    void channel_panic(tlv_packet_t *tp);
+    void reset_channel(uint8_t channel);
+    void post_control_change(uint8_t channel, uint8_t controller,
+                             uint8_t value);
+    void pan(tlv_packet_t *tp);
+    void envelope(tlv_packet_t *tp);
     void scale(tlv_packet_t *tp);
     void chord(tlv_packet_t *tp);
     void artist(tlv_packet_t *tp);
@@ -0,0 +1,190 @@
+/*
+ * Oscillator Tables of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#include "osc-tables.hpp"
+#include <array>
+#include "const-math.hpp"
+#include "midi-state-machine.hpp"
+
+static constexpr double A4_FREQ = 440.0; // freqency of concert pitch [Hz]
+static constexpr int A4_NOTE_NUMBER = 69; // MIDI note number of concert pitch
+static constexpr int NOTES_PER_OCTAVE = 12;
+#ifdef USE_DDS_OSC
+static constexpr double PHASE_TURN = 4294967296.0; // 2^32
+#endif
+
+static constexpr double
+note_freq(const size_t note)
+{
+  return A4_FREQ * const_exp2(((double)note - A4_NOTE_NUMBER) /
+                              NOTES_PER_OCTAVE);
+}
+
+typedef std::array<uint32_t, Osc_tables::NUM_NOTES> osc_table_t;
+
+static constexpr osc_table_t
+make_osc_table(const uint32_t sample_freq)
+{
+  osc_table_t table{};
+  for (size_t note = 0; note < Osc_tables::NUM_NOTES; note++) {
+#ifdef USE_DDS_OSC
+    // one full 2^32 phase turn per period
+    table[note] = const_round(PHASE_TURN * note_freq(note) / sample_freq);
+#else
+    // half (0.5) inc, since square wave elongation toggles twice per period
+    table[note] = const_round(0.5 * MIDI_state_machine::COUNT_INC *
+                              sample_freq / note_freq(note));
+#endif
+  }
+  return table;
+}
+
+const size_t
+Osc_tables::NUM_NOTES;
+
+const size_t
+Osc_tables::NUM_SAMPLE_FREQS;
+
+const uint8_t
+Osc_tables::PITCH_FRACTION_BITS;
+
+const int32_t
+Osc_tables::MAX_PITCH;
+
+const uint8_t
+Osc_tables::RATIO_BITS;
+
+static_assert(Osc_tables::NUM_SAMPLE_FREQS == 5,
+              "OSC_TABLES must list one table per supported sample rate");
+
+static constexpr osc_table_t OSC_TABLES[Osc_tables::NUM_SAMPLE_FREQS] = {
+  make_osc_table(Osc_tables::SAMPLE_FREQS[0]),
+  make_osc_table(Osc_tables::SAMPLE_FREQS[1]),
+  make_osc_table(Osc_tables::SAMPLE_FREQS[2]),
+  make_osc_table(Osc_tables::SAMPLE_FREQS[3]),
+  make_osc_table(Osc_tables::SAMPLE_FREQS[4]),
+};
+
+static const uint8_t FINE_STEP_BITS = 5; // per semitone
+static const size_t NUM_FINE_STEPS = 1u << FINE_STEP_BITS;
+static const uint8_t INTERPOLATION_BITS =
+  Osc_tables::PITCH_FRACTION_BITS - FINE_STEP_BITS;
+
+typedef std::array<uint32_t, NUM_FINE_STEPS + 1> fine_ratio_table_t;
+
+/*
+ * Ratios of the oscillator parameter from a note up to the next
+ * semitone, in fine steps, as fixed point values with RATIO_BITS
+ * fractional bits: increasing for phase increments, decreasing for
+ * count wraps, as these are inversely proportional to the frequency.
+ */
+static constexpr fine_ratio_table_t
+make_fine_ratio_table()
+{
+  fine_ratio_table_t table{};
+  for (size_t step = 0; step <= NUM_FINE_STEPS; step++) {
+    const double semitones = (double)step / NUM_FINE_STEPS;
+#ifdef USE_DDS_OSC
+    const double ratio = const_exp2(semitones / NOTES_PER_OCTAVE);
+#else
+    const double ratio = const_exp2(-semitones / NOTES_PER_OCTAVE);
+#endif
+    table[step] =
+      const_round(ratio * (((uint64_t)1u) << Osc_tables::RATIO_BITS));
+  }
+  return table;
+}
+
+static constexpr fine_ratio_table_t FINE_RATIOS = make_fine_ratio_table();
+
+static_assert(FINE_RATIOS[0] == ((uint32_t)1u) << Osc_tables::RATIO_BITS,
+              "notes without fraction must keep their exact table value");
+
+#ifndef USE_DDS_OSC
+static constexpr bool
+pulse_periods_fit()
+{
+  for (size_t index = 0; index < Osc_tables::NUM_SAMPLE_FREQS; index++) {
+    // note 0 has the longest period
+    const uint64_t period = 2 * (uint64_t)OSC_TABLES[index][0];
+    if (period * MIDI_state_machine::DUTY_FULL > UINT32_MAX) {
+      return false;
+    }
+  }
+  return true;
+}
+
+static_assert(pulse_periods_fit(),
+              "pulse width must scale periods in 32 bit arithmetic");
+#endif
+
+const uint32_t *
+Osc_tables::lookup(const uint32_t sample_freq)
+{
+  for (size_t index = 0; index < NUM_SAMPLE_FREQS; index++) {
+    if (SAMPLE_FREQS[index] == sample_freq) {
+      return OSC_TABLES[index].data();
+    }
+  }
+  return nullptr;
+}
+
+/*
+ * The oscillator parameter for the given pitch in 1/256 semitones,
+ * clamped to the range of MIDI notes, such that bending never takes
+ * count wraps beyond the one of note 0 (see pulse_periods_fit()).
+ */
+uint32_t
+Osc_tables::pitch_value(const uint32_t *osc_table, const int32_t pitch)
+{
+  const int32_t clamped =
+    pitch < 0 ? 0 : pitch > MAX_PITCH ? MAX_PITCH : pitch;
+  const uint32_t note = clamped >> PITCH_FRACTION_BITS;
+  const uint32_t fraction = clamped & ((1u << PITCH_FRACTION_BITS) - 1);
+  if (!fraction) {
+    return osc_table[note];
+  }
+  const uint32_t step = fraction >> INTERPOLATION_BITS;
+  const uint32_t weight = fraction & ((1u << INTERPOLATION_BITS) - 1);
+  const int32_t delta = FINE_RATIOS[step + 1] - FINE_RATIOS[step];
+  const uint32_t ratio =
+    FINE_RATIOS[step] + ((delta * (int32_t)weight) >> INTERPOLATION_BITS);
+  return ((uint64_t)osc_table[note] * ratio +
+          (((uint64_t)1u) << (RATIO_BITS - 1))) >> RATIO_BITS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
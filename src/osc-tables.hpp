@@ -0,0 +1,68 @@
+/*
+ * Oscillator Tables of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#ifndef OSC_TABLES_HPP
+#define OSC_TABLES_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Per-note oscillator parameters for each supported sample rate,
+ * computed at compile time and placed in flash: the count wrap value
+ * or, with USE_DDS_OSC, the 32 bit phase increment.  Pitches between
+ * notes (in 1/256 semitones) scale the note's value by a ratio from
+ * a table of finer steps, linearly interpolated, such that retuning
+ * an oscillator takes a single multiplication and no division.
+ */
+class Osc_tables {
+public:
+  static const size_t NUM_NOTES = 0x80;
+  static const uint8_t PITCH_FRACTION_BITS = 8;
+  static const int32_t MAX_PITCH = (NUM_NOTES - 1) << PITCH_FRACTION_BITS;
+  static const uint8_t RATIO_BITS = 30;
+  static const size_t NUM_SAMPLE_FREQS = 5;
+  static constexpr uint32_t SAMPLE_FREQS[NUM_SAMPLE_FREQS] = { // [Hz]
+    22050, 24000, 32000, 44100, 48000
+  };
+  static const uint32_t *lookup(const uint32_t sample_freq);
+  static uint32_t pitch_value(const uint32_t *osc_table, const int32_t pitch);
+};
+
+#endif /* OSC_TABLES_HPP */
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
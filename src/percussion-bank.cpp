@@ -0,0 +1,298 @@
+/*
+ * Percussion Bank of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#include "percussion-bank.hpp"
+
+const size_t
+Percussion_bank::NUM_VOICES;
+
+const uint8_t
+Percussion_bank::FIRST_NOTE;
+
+const uint8_t
+Percussion_bank::LAST_NOTE;
+
+const size_t
+Percussion_bank::NUM_DRUMS;
+
+const uint8_t
+Percussion_bank::LEVEL_BITS;
+
+const uint32_t
+Percussion_bank::LEVEL_FULL;
+
+const uint8_t
+Percussion_bank::GAIN_BITS;
+
+const uint32_t
+Percussion_bank::TICK_FRAMES;
+
+/*
+ * GM percussion key map, from the acoustic bass drum (35) up to the
+ * open triangle (81): low clock rates rumble, high ones hiss; short
+ * mode gives a pitched buzz for toms, bells and wooden sounds.
+ */
+static constexpr Percussion_bank::drum_t DRUMS[Percussion_bank::NUM_DRUMS] = {
+  { 600, 160, false }, // 35 acoustic bass drum
+  { 800, 120, false }, // 36 bass drum 1
+  { 12000, 30, false }, // 37 side stick
+  { 8000, 150, false }, // 38 acoustic snare
+  { 10000, 120, false }, // 39 hand clap
+  { 9000, 130, false }, // 40 electric snare
+  { 1000, 220, true }, // 41 low floor tom
+  { 22000, 40, false }, // 42 closed hi-hat
+  { 1200, 220, true }, // 43 high floor tom
+  { 22000, 60, false }, // 44 pedal hi-hat
+  { 1500, 200, true }, // 45 low tom
+  { 22000, 300, false }, // 46 open hi-hat
+  { 1800, 200, true }, // 47 low-mid tom
+  { 2200, 180, true }, // 48 hi-mid tom
+  { 18000, 800, false }, // 49 crash cymbal 1
+  { 2600, 180, true }, // 50 high tom
+  { 16000, 500, true }, // 51 ride cymbal 1
+  { 14000, 600, false }, // 52 chinese cymbal
+  { 12000, 400, true }, // 53 ride bell
+  { 20000, 120, false }, // 54 tambourine
+  { 20000, 300, false }, // 55 splash cymbal
+  { 5000, 150, true }, // 56 cowbell
+  { 17000, 800, false }, // 57 crash cymbal 2
+  { 6000, 400, false }, // 58 vibraslap
+  { 15000, 500, true }, // 59 ride cymbal 2
+  { 4000, 100, true }, // 60 hi bongo
+  { 3200, 110, true }, // 61 low bongo
+  { 3600, 60, true }, // 62 mute hi conga
+  { 3000, 140, true }, // 63 open hi conga
+  { 2400, 150, true }, // 64 low conga
+  { 5000, 120, true }, // 65 high timbale
+  { 4000, 130, true }, // 66 low timbale
+  { 8000, 150, true }, // 67 high agogo
+  { 6500, 160, true }, // 68 low agogo
+  { 20000, 80, false }, // 69 cabasa
+  { 22000, 60, false }, // 70 maracas
+  { 9000, 200, true }, // 71 short whistle
+  { 9000, 400, true }, // 72 long whistle
+  { 8000, 100, false }, // 73 short guiro
+  { 8000, 250, false }, // 74 long guiro
+  { 7000, 40, true }, // 75 claves
+  { 6000, 50, true }, // 76 hi wood block
+  { 4500, 50, true }, // 77 low wood block
+  { 3000, 120, true }, // 78 mute cuica
+  { 2500, 120, true }, // 79 open cuica
+  { 14000, 100, true }, // 80 mute triangle
+  { 14000, 600, true } // 81 open triangle
+};
+
+static const uint16_t LFSR_SEED = 0x0001;
+static const uint8_t HI_HAT_CLOSED = 42;
+static const uint8_t HI_HAT_PEDAL = 44;
+static const uint8_t HI_HAT_OPEN = 46;
+
+Percussion_bank::Percussion_bank()
+{
+}
+
+Percussion_bank::~Percussion_bank()
+{
+}
+
+void
+Percussion_bank::init(const uint32_t sample_freq)
+{
+  _voice_count = 0;
+  set_sample_freq(sample_freq);
+}
+
+/*
+ * Divisions are done here once per sample rate rather than on each
+ * note.  Voices already sounding keep their rates until they end.
+ */
+void
+Percussion_bank::set_sample_freq(const uint32_t sample_freq)
+{
+  for (size_t drum = 0; drum < NUM_DRUMS; drum++) {
+    const uint32_t hold_frames = sample_freq / DRUMS[drum].clock_freq;
+    _hold_frames[drum] = hold_frames ? hold_frames : 1;
+    const uint64_t decay_frames_1000 =
+      (uint64_t)DRUMS[drum].decay_time * sample_freq;
+    _decay_inc[drum] =
+      (uint64_t)LEVEL_FULL * TICK_FRAMES * 1000 / decay_frames_1000;
+  }
+}
+
+size_t
+Percussion_bank::get_voice_count() const
+{
+  return _voice_count;
+}
+
+void
+Percussion_bank::cut_all()
+{
+  _voice_count = 0;
+}
+
+// the hi-hats cut off each other, like GM exclusive class 1
+static uint8_t
+choke_group(const uint8_t note)
+{
+  if ((note == HI_HAT_PEDAL) || (note == HI_HAT_OPEN)) {
+    return HI_HAT_CLOSED;
+  }
+  return note;
+}
+
+/*
+ * Start the drum of the given note at full level, taking over the
+ * voice of the same drum (or choke group) if still sounding, else a
+ * free voice, else the quietest one.  Returns false for notes
+ * outside the GM percussion key map.
+ */
+bool
+Percussion_bank::trigger(const uint8_t note, const uint8_t amplitude_left,
+                         const uint8_t amplitude_right)
+{
+  if ((note < FIRST_NOTE) || (note > LAST_NOTE)) {
+    return false;
+  }
+  const uint8_t group = choke_group(note);
+  size_t index = 0;
+  while ((index < _voice_count) &&
+         (choke_group(_voices[index].note) != group)) {
+    index++;
+  }
+  if (index == NUM_VOICES) {
+    index = 0;
+    for (size_t other = 1; other < _voice_count; other++) {
+      if (_voices[other].level * (uint64_t)(_voices[other].amplitude_left +
+                                            _voices[other].amplitude_right) <
+          _voices[index].level * (uint64_t)(_voices[index].amplitude_left +
+                                            _voices[index].amplitude_right)) {
+        index = other;
+      }
+    }
+  } else if (index == _voice_count) {
+    _voice_count++;
+    _voices[index].lfsr = LFSR_SEED;
+  }
+  const size_t drum = note - FIRST_NOTE;
+  drum_voice_t *voice = &_voices[index];
+  voice->level = LEVEL_FULL;
+  voice->decay_inc = _decay_inc[drum];
+  voice->hold_frames = _hold_frames[drum];
+  voice->hold_count = _hold_frames[drum];
+  voice->amplitude_left = amplitude_left;
+  voice->amplitude_right = amplitude_right;
+  voice->note = note;
+  voice->short_mode = DRUMS[drum].short_mode;
+  update_elongations(voice);
+  return true;
+}
+
+void
+Percussion_bank::free_voice(const size_t index)
+{
+  _voices[index] = _voices[--_voice_count];
+}
+
+void
+Percussion_bank::update_elongations(drum_voice_t *voice)
+{
+  const int32_t gain = voice->level >> (LEVEL_BITS - GAIN_BITS);
+  voice->elongation_left = (voice->amplitude_left * gain) >> GAIN_BITS;
+  voice->elongation_right = (voice->amplitude_right * gain) >> GAIN_BITS;
+}
+
+/*
+ * Called on every envelope tick while any voice sounds.
+ */
+void
+Percussion_bank::update()
+{
+  for (size_t index = 0; index < _voice_count;) {
+    drum_voice_t *voice = &_voices[index];
+    if (voice->level <= voice->decay_inc) {
+      free_voice(index);
+      continue; // the last voice moved into this slot
+    }
+    voice->level -= voice->decay_inc;
+    update_elongations(voice);
+    index++;
+  }
+}
+
+/*
+ * Add all voices to the mix buffers.  The LFSR shifts right, feeding
+ * back the XOR of bit 0 and bit 1 (or bit 6 in short mode) into bit
+ * 14; bit 0 selects the sign of the output.
+ */
+void
+Percussion_bank::mix(int32_t *mix_left, int32_t *mix_right,
+                     const uint32_t frame_count)
+{
+  for (size_t index = 0; index < _voice_count; index++) {
+    drum_voice_t *voice = &_voices[index];
+    const uint8_t tap = voice->short_mode ? 6 : 1;
+    uint16_t lfsr = voice->lfsr;
+    uint32_t hold_count = voice->hold_count;
+    const int32_t sign = -(int32_t)(lfsr & 0x1);
+    int32_t elongation_left = (voice->elongation_left ^ sign) - sign;
+    int32_t elongation_right = (voice->elongation_right ^ sign) - sign;
+    uint32_t frame = 0;
+    while (frame < frame_count) {
+      const uint32_t remaining = frame_count - frame;
+      const uint32_t span = hold_count < remaining ? hold_count : remaining;
+      const uint32_t end = frame + span;
+      for (; frame < end; frame++) {
+        mix_left[frame] += elongation_left;
+        mix_right[frame] += elongation_right;
+      }
+      hold_count -= span;
+      if (!hold_count) {
+        const uint16_t feedback = (lfsr ^ (lfsr >> tap)) & 0x1;
+        lfsr = (lfsr >> 1) | (feedback << 14);
+        const int32_t next_sign = -(int32_t)(lfsr & 0x1);
+        elongation_left = (voice->elongation_left ^ next_sign) - next_sign;
+        elongation_right = (voice->elongation_right ^ next_sign) - next_sign;
+        hold_count = voice->hold_frames;
+      }
+    }
+    voice->lfsr = lfsr;
+    voice->hold_count = hold_count;
+  }
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
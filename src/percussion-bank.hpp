@@ -0,0 +1,102 @@
+/*
+ * Percussion Bank of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#ifndef PERCUSSION_BANK_HPP
+#define PERCUSSION_BANK_HPP
+
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * A small bank of noise voices for the GM percussion channel, in the
+ * manner of 8 bit sound chips: each voice clocks a 15 bit LFSR at a
+ * fixed rate per drum and plays its output bit as a 1 bit noise
+ * wave, which (like the square oscillators) stays constant between
+ * clocks and is thus mixed span by span.  Its level decays linearly
+ * on the envelope ticks of the MIDI state machine.
+ */
+class Percussion_bank {
+public:
+  static const size_t NUM_VOICES = 8;
+  static const uint8_t FIRST_NOTE = 35; // acoustic bass drum
+  static const uint8_t LAST_NOTE = 81; // open triangle
+  static const size_t NUM_DRUMS = LAST_NOTE - FIRST_NOTE + 1;
+  static const uint8_t LEVEL_BITS = 24;
+  static const uint32_t LEVEL_FULL = ((uint32_t)1u) << LEVEL_BITS;
+  static const uint8_t GAIN_BITS = 15;
+  static const uint32_t TICK_FRAMES = 32;
+  typedef struct {
+    uint16_t clock_freq; // LFSR clocks per second [Hz]
+    uint16_t decay_time; // from full level to silence [ms]
+    bool short_mode; // 93 step LFSR sequence, sounds metallic or tonal
+  } drum_t;
+  typedef struct {
+    uint32_t level; // 0..LEVEL_FULL
+    uint32_t decay_inc; // per tick
+    uint16_t lfsr;
+    uint16_t hold_frames; // frames per LFSR clock
+    uint16_t hold_count; // frames up to the next LFSR clock
+    int16_t elongation_left; // magnitude
+    int16_t elongation_right; // magnitude
+    uint8_t amplitude_left; // panned velocity
+    uint8_t amplitude_right; // panned velocity
+    uint8_t note;
+    bool short_mode;
+  } drum_voice_t;
+  Percussion_bank();
+  virtual ~Percussion_bank();
+  void init(const uint32_t sample_freq);
+  void set_sample_freq(const uint32_t sample_freq);
+  bool trigger(const uint8_t note, const uint8_t amplitude_left,
+               const uint8_t amplitude_right);
+  size_t get_voice_count() const;
+  void cut_all();
+  void update();
+  void mix(int32_t *mix_left, int32_t *mix_right,
+           const uint32_t frame_count);
+private:
+  drum_voice_t _voices[NUM_VOICES]; // dense, in no particular order
+  size_t _voice_count = 0;
+  uint16_t _hold_frames[NUM_DRUMS]; // for the current sample rate
+  uint32_t _decay_inc[NUM_DRUMS]; // for the current sample rate
+  void free_voice(const size_t index);
+  void update_elongations(drum_voice_t *voice);
+};
+
+#endif /* PERCUSSION_BANK_HPP */
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -31,11 +31,13 @@
  */
 
 #include "pico-square-immersion.hpp"
+#include "osc-tables.hpp"
+#include <tlv.h>
 #include "i2s-audio-target.hpp"
 #include "pwm-audio-target.hpp"
 #include <network-source.hpp>
-#include <math.h>
 #include "pico/stdlib.h"
+#include "pico/multicore.h"
 #include <wifi-stuff.hpp>
 #include <cstdio>
 #include "ntp.hpp"
@@ -44,6 +46,16 @@
 
 //#define USE_PWM_AUDIO
 
+// render audio on core 1, everything else on core 0
+#define USE_DUAL_CORE
+
+// let the I2S DMA play the rendered buffers without copying them
+#define USE_I2S_DIRECT_DMA
+
+#if defined(USE_PWM_AUDIO) && defined(USE_DUAL_CORE)
+#error "PWM audio claims core 1 for itself; disable USE_DUAL_CORE"
+#endif
+
 const uint32_t
 Simple_stupid_synth::GPIO_PIN_LED = 4; // 25 is used for WiFi on pico_w
 
@@ -53,73 +65,168 @@ const uint32_t MAGNETIC_SOUTH = 7;
 const uint32_t
 Simple_stupid_synth::DEFAULT_SAMPLE_FREQ = 24000; // [HZ]
 
-const uint8_t
-Simple_stupid_synth::VOL_BITS = 8;
+const uint16_t
+Simple_stupid_synth::DEFAULT_MAX_BUFFERS_PER_TASK = 4;
+
+Simple_stupid_synth *
+Simple_stupid_synth::_core1_synth = 0;
 
 Simple_stupid_synth::
 Simple_stupid_synth(Audio_target *const audio_target,
                     MIDI_state_machine *const midi_state_machine,
+                    USB_MIDI_source *const usb_midi_source,
                     Network_source *const network_source,
                     NTP_client *const ntp,
                     const uint8_t gpio_pin_activity_indicator) :
   _is_stereo(audio_target->is_stereo()),
   _audio_target(audio_target), _midi_state_machine(midi_state_machine),
+  _usb_midi_source(usb_midi_source),
   _network_source(network_source),
-  _ntp(ntp)
+  _ntp(ntp),
+  _synth_renderer(midi_state_machine),
+  _render_governor(midi_state_machine)
 {
   const uint32_t sample_freq = _audio_target->get_sample_freq();
-  _midi_state_machine->init(sample_freq, gpio_pin_activity_indicator);
+  if (!_midi_state_machine->init(sample_freq)) {
+    panic("no oscillator tables for sample rate %lu Hz\n", sample_freq);
+  }
+  led_init(gpio_pin_activity_indicator);
+  _usb_midi_source->init();
+  _audio_target_anchors_clock = _audio_target->set_sample_clock(&_sample_clock);
+  _usb_midi_source->set_sample_clock(&_sample_clock);
+  _usb_midi_source->set_output_latency_us(_audio_target->get_latency_us());
+  _network_source->set_sample_clock(&_sample_clock);
+  _network_source->set_tlv_callback(TLV_TYPE_SAMPLE_FREQ,
+                                    [this](tlv_packet_t *tp) {
+    tlv_type_sample_freq_t *p = (tlv_type_sample_freq_t *)tp->payload;
+    if (!request_sample_freq(p->sample_freq)) {
+      printf("WARNING: unsupported sample rate %lu Hz\n", p->sample_freq);
+    }
+  });
   sleep_ms(10);
 }
 
+/*
+ * May be called from any core; the switch itself is performed by
+ * whichever core renders audio, right before its next buffer.
+ */
+bool
+Simple_stupid_synth::request_sample_freq(const uint32_t sample_freq)
+{
+  if (!Osc_tables::lookup(sample_freq)) {
+    return false;
+  }
+  _requested_sample_freq.store(sample_freq);
+  return true;
+}
+
 void
-Simple_stupid_synth::synth_task()
+Simple_stupid_synth::switch_sample_freq(const uint32_t sample_freq)
 {
-  struct audio_buffer *audio_buffer = _audio_target->take_audio_buffer(false);
-  if (!audio_buffer) {
+  if (sample_freq == _audio_target->get_sample_freq()) {
     return;
   }
-  const uint32_t audio_buffer_sample_count = audio_buffer->max_sample_count;
-  if (!audio_buffer_sample_count) {
+  _audio_target->set_sample_freq(sample_freq);
+  _midi_state_machine->set_sample_freq(sample_freq);
+  _usb_midi_source->set_output_latency_us(_audio_target->get_latency_us());
+  _sample_clock_anchored = false;
+  printf("sample rate switched to %lu Hz\n", sample_freq);
+}
+
+void
+Simple_stupid_synth::led_init(const uint8_t gpio_pin_activity_indicator)
+{
+  gpio_init(gpio_pin_activity_indicator);
+  gpio_set_dir(gpio_pin_activity_indicator, GPIO_OUT);
+  _midi_state_machine->set_activity_indicator
+    ([gpio_pin_activity_indicator](const bool active) {
+      gpio_put(gpio_pin_activity_indicator, active ? 1 : 0);
+    });
+}
+
+/*
+ * Limits the number of buffers rendered by a single call of
+ * synth_task(); 0 means no limit.  Catching up on all free buffers
+ * at once recovers fastest from a slow main loop iteration, while a
+ * cap keeps a single-core main loop responsive to MIDI input.
+ */
+void
+Simple_stupid_synth::set_max_buffers_per_task(const uint16_t
+                                              max_buffers_per_task)
+{
+  _max_buffers_per_task = max_buffers_per_task;
+}
+
+/*
+ * Unless the audio target anchors the sample clock itself whenever a
+ * buffer starts playing, anchor it to the first sample rendered into
+ * an empty pool: initially, after a sample rate switch and after an
+ * underrun.  That sample starts playing once the output has finished
+ * the buffer in flight, which the target estimates.  In between, the
+ * clock converts at the frame rate the output actually runs at,
+ * rather than at the nominal sample rate.
+ */
+void
+Simple_stupid_synth::anchor_sample_clock()
+{
+  if (_audio_target_anchors_clock) {
     return;
   }
-  audio_buffer->sample_count = audio_buffer_sample_count;
-  int16_t *out = (int16_t *) audio_buffer->buffer->bytes;
-  const uint16_t vol_mul = round(2.0 * (((long)1u) << VOL_BITS));
-  const size_t num_osc = MIDI_state_machine::NUM_OSC;
-  const uint32_t count_inc = MIDI_state_machine::COUNT_INC;
-  MIDI_state_machine::osc_status_t *osc_statuses =
-    _midi_state_machine->get_osc_statuses();
-  const uint32_t total_sample_count =
-    audio_buffer->max_sample_count * (_is_stereo ? 2 : 1);
-  for (uint32_t sample_index = 0; sample_index < total_sample_count;) {
-    int64_t sample_value = 0;
-    for (size_t osc = 0; osc < num_osc; osc++) {
-      MIDI_state_machine::osc_status_t *osc_status = &osc_statuses[osc];
-      uint32_t elongation = osc_status->elongation;
-      if (elongation) {
-        const uint32_t count_wrap = osc_status->count_wrap;
-        uint32_t count = osc_status->count;
-        count += count_inc;
-        if (count >= count_wrap) {
-          count -= count_wrap;
-          elongation = -elongation;
-          osc_status->elongation = elongation;
-        }
-        osc_status->count = count;
-        sample_value += elongation;
-      }
+  const uint32_t underrun_count = _audio_target->get_underrun_count();
+  if (_sample_clock_anchored && (underrun_count == _anchored_underrun_count)) {
+    return;
+  }
+  uint32_t frame_freq_num, frame_freq_den;
+  _audio_target->get_frame_freq(&frame_freq_num, &frame_freq_den);
+  const uint64_t in_flight_us =
+    (uint64_t)_audio_target->get_in_flight_frames() * 1000000 *
+    frame_freq_den / frame_freq_num;
+  _sample_clock.set_anchor(time_us_64() + in_flight_us,
+                           _synth_renderer.get_sample_time(),
+                           Sample_clock::get_frames_per_us(frame_freq_num,
+                                                           frame_freq_den));
+  _sample_clock_anchored = true;
+  _anchored_underrun_count = underrun_count;
+}
+
+/*
+ * Render into every free buffer of the pool (up to the configured
+ * cap) rather than just one, such that the pool is topped up again
+ * right after any delay.  The time spent rendering each buffer is
+ * passed on to the governor, which steals voices before the
+ * rendering core falls behind the output.
+ */
+void
+Simple_stupid_synth::synth_task()
+{
+  const uint32_t requested_sample_freq = _requested_sample_freq.exchange(0);
+  if (requested_sample_freq) {
+    switch_sample_freq(requested_sample_freq);
+  }
+  for (uint16_t buffer_count = 0;
+       !_max_buffers_per_task || (buffer_count < _max_buffers_per_task);
+       buffer_count++) {
+    struct audio_buffer *audio_buffer =
+      _audio_target->take_audio_buffer(false);
+    if (!audio_buffer) {
+      return;
     }
-    const int16_t scaled_sample_value =
-      (int16_t)((sample_value * vol_mul) >> VOL_BITS);
-    if (_is_stereo) {
-      out[sample_index++] = scaled_sample_value; // left channel
-      out[sample_index++] = scaled_sample_value; // right channel
-    } else {
-      out[sample_index++] = scaled_sample_value; // mono channel
+    const uint32_t audio_buffer_sample_count = audio_buffer->max_sample_count;
+    if (!audio_buffer_sample_count) {
+      return;
     }
+    audio_buffer->sample_count = audio_buffer_sample_count;
+    anchor_sample_clock();
+    audio_buffer->user_data = (uint32_t)_synth_renderer.get_sample_time();
+    int16_t *out = (int16_t *) audio_buffer->buffer->bytes;
+    const uint64_t render_start_us = time_us_64();
+    _synth_renderer.render(out, audio_buffer_sample_count, _is_stereo);
+    const uint32_t render_us = time_us_64() - render_start_us;
+    _audio_target->give_audio_buffer(audio_buffer);
+    const uint32_t period_us = (uint64_t)audio_buffer_sample_count * 1000000 /
+      _audio_target->get_sample_freq();
+    _render_governor.update(render_us, period_us);
   }
-  _audio_target->give_audio_buffer(audio_buffer);
 }
 
 #include "hardware/adc.h"
@@ -176,20 +283,105 @@ void magnetic_task(void)
   }
 }
 
+/*
+ * Report changes of the underrun statistics, such that the buffer
+ * count and size of the audio target can be tuned from the console
+ * output, as well as voices stolen by the render governor.
+ */
+void
+Simple_stupid_synth::audio_stats_task()
+{
+  const uint32_t underrun_count = _audio_target->get_underrun_count();
+  const uint32_t recovery_count = _audio_target->get_recovery_count();
+  if ((underrun_count != _reported_underrun_count) ||
+      (recovery_count != _reported_recovery_count)) {
+    printf("audio underruns: %lu, recoveries: %lu\n",
+           underrun_count, recovery_count);
+    _reported_underrun_count = underrun_count;
+    _reported_recovery_count = recovery_count;
+  }
+  const uint32_t stolen_voice_count =
+    _midi_state_machine->get_stolen_voice_count();
+  if (stolen_voice_count != _reported_stolen_voice_count) {
+    printf("voices stolen: %lu, voice limit: %u, peak load: %u permille\n",
+           stolen_voice_count,
+           (unsigned int)_midi_state_machine->get_voice_limit(),
+           _render_governor.get_peak_load());
+    _reported_stolen_voice_count = stolen_voice_count;
+  }
+  const uint32_t dropped_event_count =
+    _midi_state_machine->get_dropped_event_count();
+  if (dropped_event_count != _reported_dropped_event_count) {
+    printf("MIDI events dropped: %lu\n", dropped_event_count);
+    _reported_dropped_event_count = dropped_event_count;
+  }
+  // the meters cover the most recently rendered buffer only
+  const Mix_bus *mix_bus = _synth_renderer.get_mix_bus();
+  const uint32_t clipped_sample_count =
+    mix_bus->get_total_clipped_sample_count();
+  if (clipped_sample_count != _reported_clipped_sample_count) {
+    const Mix_bus::meters_t *meters = mix_bus->get_meters();
+    printf("samples clipped: %lu, last buffer peak: %lu, limited: %u, "
+           "clipped: %u\n",
+           clipped_sample_count, meters->peak,
+           meters->limited_sample_count, meters->clipped_sample_count);
+    _reported_clipped_sample_count = clipped_sample_count;
+  }
+}
+
 void
 Simple_stupid_synth::main_loop()
 {
   for (;;) {
-    _midi_state_machine->tx_task();
-    _midi_state_machine->rx_task();
+    _usb_midi_source->tx_task();
+    _usb_midi_source->rx_task();
     _network_source->rx_task();
     _ntp->update_time();
     synth_task();
+    audio_stats_task();
+    adc_task();
+    magnetic_task();
+  }
+}
+
+/*
+ * Core 1 exclusively owns the oscillators and renders audio, while
+ * core 0 handles USB, network, NTP, display and LEDs.  Note events
+ * reach core 1 only via the MIDI state machine's event queue, such
+ * that slow I2C or SPI transfers on core 0 cannot delay rendering.
+ */
+void
+Simple_stupid_synth::main_loop_dual_core()
+{
+  _midi_state_machine->enable_event_queue();
+  _core1_synth = this;
+  multicore_launch_core1(core1_entry);
+  for (;;) {
+    _usb_midi_source->tx_task();
+    _usb_midi_source->rx_task();
+    _network_source->rx_task();
+    _ntp->update_time();
+    audio_stats_task();
     adc_task();
     magnetic_task();
   }
 }
 
+void
+Simple_stupid_synth::core1_entry()
+{
+  _core1_synth->render_loop();
+}
+
+void
+Simple_stupid_synth::render_loop()
+{
+  for (;;) {
+    // posted events are applied by the renderer on their exact sample
+    synth_task();
+  }
+}
+
 void display_wifi()
 {
   memset(display_buffer, 0, SSD1306_BUF_LEN);
@@ -225,7 +417,12 @@ int main()
     PICO_AUDIO_I2S_DATA_PIN; // GPIO 9 (DATA)
   I2S_audio_target audio_target(Simple_stupid_synth::DEFAULT_SAMPLE_FREQ,
                                 gpio_pin_i2s_clock_base, gpio_pin_i2s_data);
+#ifdef USE_I2S_DIRECT_DMA
+  audio_target.init(I2S_audio_target::DEFAULT_BUFFER_COUNT,
+                    I2S_audio_target::DEFAULT_BUFFER_SAMPLE_COUNT, true);
+#else
   audio_target.init();
+#endif
 #endif
 
   init_magnetic_sensor();
@@ -241,6 +438,7 @@ int main()
   init_adc();
 
   MIDI_state_machine midi_state_machine;
+  USB_MIDI_source usb_midi_source(&midi_state_machine);
   Network_source network_source(&midi_state_machine);
   NTP_client ntp;
   network_source.set_ntp(&ntp);
@@ -266,9 +464,14 @@ int main()
     Simple_stupid_synth::GPIO_PIN_LED;
   Simple_stupid_synth simple_stupid_synth(&audio_target,
                                           &midi_state_machine,
+                                          &usb_midi_source,
                                           &network_source,
                                           &ntp,
                                           gpio_pin_activity_indicator);
+#ifdef USE_DUAL_CORE
+  simple_stupid_synth.main_loop_dual_core();
+#else
   simple_stupid_synth.main_loop();
+#endif
   return 0;
 }
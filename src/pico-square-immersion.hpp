@@ -33,9 +33,14 @@
 #ifndef SIMPLE_STUPID_SYNTH_HPP
 #define SIMPLE_STUPID_SYNTH_HPP
 
+#include <atomic>
 #include <inttypes.h>
 #include "midi-state-machine.hpp"
+#include "usb-midi-source.hpp"
 #include "audio-target.hpp"
+#include "synth-renderer.hpp"
+#include "render-governor.hpp"
+#include "sample-clock.hpp"
 #include <network-source.hpp>
 #include <ntp.hpp>
 
@@ -43,20 +48,45 @@ class Simple_stupid_synth {
 public:
   static const uint32_t DEFAULT_SAMPLE_FREQ; // [HZ]
   static const uint32_t GPIO_PIN_LED;
+  static const uint16_t DEFAULT_MAX_BUFFERS_PER_TASK;
   Simple_stupid_synth(Audio_target *const audio_target,
                       MIDI_state_machine *const midi_state_machine,
+                      USB_MIDI_source *const usb_midi_source,
                       Network_source *const network_source,
                       NTP_client *const ntp,
                       const uint8_t gpio_pin_activity_indicator);
   void main_loop();
+  bool request_sample_freq(const uint32_t sample_freq);
+  void set_max_buffers_per_task(const uint16_t max_buffers_per_task);
+  void main_loop_dual_core();
 private:
-  static const uint8_t VOL_BITS;
+  static Simple_stupid_synth *_core1_synth;
+  static void core1_entry();
   const bool _is_stereo;
   Audio_target *const _audio_target;
   MIDI_state_machine *const _midi_state_machine;
+  USB_MIDI_source *const _usb_midi_source;
   Network_source *const _network_source;
   NTP_client *const _ntp;
+  Synth_renderer _synth_renderer;
+  Render_governor _render_governor;
+  Sample_clock _sample_clock;
+  bool _audio_target_anchors_clock = false;
+  bool _sample_clock_anchored = false;
+  uint32_t _anchored_underrun_count = 0;
+  std::atomic<uint32_t> _requested_sample_freq{0};
+  uint16_t _max_buffers_per_task = DEFAULT_MAX_BUFFERS_PER_TASK;
+  uint32_t _reported_underrun_count = 0;
+  uint32_t _reported_recovery_count = 0;
+  uint32_t _reported_stolen_voice_count = 0;
+  uint32_t _reported_dropped_event_count = 0;
+  uint32_t _reported_clipped_sample_count = 0;
+  void led_init(const uint8_t gpio_pin_activity_indicator);
+  void switch_sample_freq(const uint32_t sample_freq);
+  void anchor_sample_clock();
   void synth_task();
+  void audio_stats_task();
+  void render_loop();
 };
 
 #endif /* SIMPLE_STUPID_SYNTH_HPP */
@@ -59,6 +59,8 @@ PWM_audio_target::init(const uint16_t buffer_count,
                        const enum audio_correction_mode mode)
 {
   const int32_t max_latency_ms = -1; // don't care
+  _buffer_count = buffer_count;
+  _buffer_sample_count = buffer_sample_count;
   _target_producer_pool =
     audio_new_producer_pool(&_target_audio_buffer_format,
                             buffer_count, buffer_sample_count);
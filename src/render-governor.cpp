@@ -0,0 +1,113 @@
+/*
+ * Render Governor of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#include "render-governor.hpp"
+
+const uint16_t
+Render_governor::HIGH_LOAD = 850;
+
+const uint16_t
+Render_governor::LOW_LOAD = 600;
+
+const uint16_t
+Render_governor::RELAX_BUFFERS = 64;
+
+const size_t
+Render_governor::MIN_VOICE_LIMIT = 8;
+
+Render_governor::Render_governor(MIDI_state_machine *const midi_state_machine)
+  : _midi_state_machine(midi_state_machine)
+{
+}
+
+Render_governor::~Render_governor()
+{
+}
+
+uint16_t
+Render_governor::get_load() const
+{
+  return _load;
+}
+
+uint16_t
+Render_governor::get_peak_load() const
+{
+  return _peak_load;
+}
+
+/*
+ * Policy: whenever a buffer took more than HIGH_LOAD of its playing
+ * time to render, shed an eighth of the sounding voices (at least
+ * one, but keep MIN_VOICE_LIMIT), such that a sudden overload is
+ * resolved within a few buffers.  After RELAX_BUFFERS consecutive
+ * buffers below LOW_LOAD, allow one more voice again.  The gap
+ * between both thresholds keeps the limit from oscillating.
+ */
+void
+Render_governor::update(const uint32_t render_us, const uint32_t period_us)
+{
+  const uint32_t load = period_us ? (uint64_t)render_us * 1000 / period_us : 0;
+  _load = load > UINT16_MAX ? UINT16_MAX : load;
+  if (_load > _peak_load) {
+    _peak_load = _load;
+  }
+  const size_t voice_limit = _midi_state_machine->get_voice_limit();
+  if (_load > HIGH_LOAD) {
+    _relaxed_buffers = 0;
+    const size_t voice_count = _midi_state_machine->get_voice_count();
+    if (voice_count <= MIN_VOICE_LIMIT) {
+      return; // overloaded by something else than voices
+    }
+    const size_t shed = voice_count >> 3 ? voice_count >> 3 : 1;
+    const size_t new_limit =
+      voice_count - shed > MIN_VOICE_LIMIT ?
+      voice_count - shed : MIN_VOICE_LIMIT;
+    _midi_state_machine->set_voice_limit(new_limit);
+  } else if (_load < LOW_LOAD) {
+    if (++_relaxed_buffers >= RELAX_BUFFERS) {
+      _relaxed_buffers = 0;
+      if (voice_limit < MIDI_state_machine::NUM_VOICES) {
+        _midi_state_machine->set_voice_limit(voice_limit + 1);
+      }
+    }
+  } else {
+    _relaxed_buffers = 0;
+  }
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,74 @@
+/*
+ * Render Governor of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#ifndef RENDER_GOVERNOR_HPP
+#define RENDER_GOVERNOR_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "midi-state-machine.hpp"
+
+/*
+ * Keeps rendering within the CPU budget: for each buffer, the time
+ * spent rendering it is compared against the time the buffer takes
+ * to play.  Rather than letting an overloaded core underrun the
+ * output, the governor lowers the voice limit of the MIDI state
+ * machine, which steals the quietest voices, and raises it again
+ * slowly once the load has been low for a while.  Like the renderer,
+ * the governor does not depend on any hardware.
+ */
+class Render_governor {
+public:
+  static const uint16_t HIGH_LOAD; // [permille]
+  static const uint16_t LOW_LOAD; // [permille]
+  static const uint16_t RELAX_BUFFERS;
+  static const size_t MIN_VOICE_LIMIT;
+  Render_governor(MIDI_state_machine *const midi_state_machine);
+  virtual ~Render_governor();
+  void update(const uint32_t render_us, const uint32_t period_us);
+  uint16_t get_load() const;
+  uint16_t get_peak_load() const;
+private:
+  MIDI_state_machine *const _midi_state_machine;
+  uint16_t _load = 0; // of the last buffer [permille]
+  uint16_t _peak_load = 0; // since start [permille]
+  uint16_t _relaxed_buffers = 0; // consecutive buffers below LOW_LOAD
+};
+
+#endif /* RENDER_GOVERNOR_HPP */
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
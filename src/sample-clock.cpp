@@ -0,0 +1,131 @@
+/*
+ * Sample Clock of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#include "sample-clock.hpp"
+
+Sample_clock::Sample_clock()
+{
+}
+
+Sample_clock::~Sample_clock()
+{
+}
+
+const uint8_t
+Sample_clock::RATE_FRACTION_BITS;
+
+// time is split at this bit for multiplying it with the frame rate
+static const uint8_t TIME_SPLIT_BITS = 20;
+
+/*
+ * Returns the frame rate as frames per microsecond with
+ * RATE_FRACTION_BITS fractional bits, such that conversions stay
+ * exact to a fraction of a sample for days; 0 for no rate.
+ */
+uint64_t
+Sample_clock::get_frames_per_us(const uint32_t frame_freq_num,
+                                const uint32_t frame_freq_den)
+{
+  if (!frame_freq_den) {
+    return 0;
+  }
+  const uint64_t frames_per_s =
+    ((uint64_t)(frame_freq_num / frame_freq_den) << RATE_FRACTION_BITS) +
+    ((uint64_t)(frame_freq_num % frame_freq_den) << RATE_FRACTION_BITS) /
+    frame_freq_den;
+  return (frames_per_s + 500000) / 1000000;
+}
+
+/*
+ * Writer side of the sequence lock: the sequence number is odd while
+ * the anchor is being updated.  Just stores, such that it is cheap
+ * enough for an interrupt handler.
+ */
+void
+Sample_clock::set_anchor(const uint64_t time_us, const uint64_t sample_time,
+                         const uint64_t frames_per_us)
+{
+  const uint32_t sequence = _sequence.load(std::memory_order_relaxed);
+  _sequence.store(sequence + 1, std::memory_order_relaxed);
+  std::atomic_thread_fence(std::memory_order_release);
+  _anchor_time_us = time_us;
+  _anchor_sample_time = sample_time;
+  _frames_per_us = frames_per_us;
+  _sequence.store(sequence + 2, std::memory_order_release);
+}
+
+void
+Sample_clock::clear_anchor()
+{
+  set_anchor(0, 0, 0);
+}
+
+/*
+ * Returns 0 (meaning "as soon as possible") while the clock is not
+ * anchored or if the time precedes the anchor.  The time since the
+ * anchor is multiplied in two parts, such that neither product
+ * overflows for up to 2^44us (about 200 days).
+ */
+uint64_t
+Sample_clock::to_sample_time(const uint64_t time_us) const
+{
+  uint64_t anchor_time_us;
+  uint64_t anchor_sample_time;
+  uint64_t frames_per_us;
+  uint32_t sequence;
+  do {
+    sequence = _sequence.load(std::memory_order_acquire);
+    anchor_time_us = _anchor_time_us;
+    anchor_sample_time = _anchor_sample_time;
+    frames_per_us = _frames_per_us;
+    std::atomic_thread_fence(std::memory_order_acquire);
+  } while ((sequence & 0x1) ||
+           (sequence != _sequence.load(std::memory_order_relaxed)));
+  if (!frames_per_us || (time_us < anchor_time_us)) {
+    return 0;
+  }
+  const uint64_t delta_us = time_us - anchor_time_us;
+  const uint64_t delta_us_low =
+    delta_us & ((((uint64_t)1) << TIME_SPLIT_BITS) - 1);
+  const uint8_t shift = RATE_FRACTION_BITS - TIME_SPLIT_BITS;
+  const uint64_t frames = (delta_us >> TIME_SPLIT_BITS) * frames_per_us +
+    ((delta_us_low * frames_per_us) >> TIME_SPLIT_BITS);
+  return anchor_sample_time +
+    ((frames + (((uint64_t)1) << (shift - 1))) >> shift);
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
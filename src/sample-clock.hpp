@@ -0,0 +1,75 @@
+/*
+ * Sample Clock of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#ifndef SAMPLE_CLOCK_HPP
+#define SAMPLE_CLOCK_HPP
+
+#include <atomic>
+#include <cstdint>
+
+/*
+ * Maps local time (microseconds since power-up) to the absolute
+ * index of the output sample that is played at that time.  The audio
+ * rendering core (or the audio output's interrupt) anchors the
+ * clock; any other core may convert time stamps concurrently, guarded
+ * by a sequence lock.  The frame rate is derived from a fraction,
+ * such that the rate the output actually runs at (e.g. as derived by
+ * a clock divider) rather than the nominal sample rate can be used.
+ * Deriving it takes 64 bit divisions, hence it is done once per rate
+ * rather than with each anchor, which may be set from an interrupt.
+ */
+class Sample_clock {
+public:
+  static const uint8_t RATE_FRACTION_BITS = 44;
+  Sample_clock();
+  virtual ~Sample_clock();
+  static uint64_t get_frames_per_us(const uint32_t frame_freq_num,
+                                    const uint32_t frame_freq_den = 1);
+  void set_anchor(const uint64_t time_us, const uint64_t sample_time,
+                  const uint64_t frames_per_us);
+  void clear_anchor();
+  uint64_t to_sample_time(const uint64_t time_us) const;
+private:
+  std::atomic<uint32_t> _sequence{0};
+  uint64_t _anchor_time_us = 0;
+  uint64_t _anchor_sample_time = 0;
+  uint64_t _frames_per_us = 0; // 0 while not anchored
+};
+
+#endif /* SAMPLE_CLOCK_HPP */
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,94 @@
+/*
+ * Single-Producer Single-Consumer Ring of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#ifndef SPSC_RING_HPP
+#define SPSC_RING_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+
+/*
+ * Wait-free ring buffer for exactly one producer and one consumer,
+ * e.g. one on each MCU core.  The producer only ever writes _tail,
+ * the consumer only ever writes _head, such that neither side needs a
+ * lock or a critical section.  CAPACITY must be a power of two.
+ */
+template <typename T, size_t CAPACITY>
+class SPSC_ring {
+public:
+  static_assert(CAPACITY && !(CAPACITY & (CAPACITY - 1)),
+                "capacity must be a power of two");
+
+  // producer side; returns false if the ring is full
+  bool push(const T &item)
+  {
+    const uint32_t tail = _tail.load(std::memory_order_relaxed);
+    if (tail - _head.load(std::memory_order_acquire) == CAPACITY) {
+      return false;
+    }
+    _items[tail & (CAPACITY - 1)] = item;
+    _tail.store(tail + 1, std::memory_order_release);
+    return true;
+  }
+
+  // consumer side; returns false if the ring is empty
+  bool pop(T *item)
+  {
+    const uint32_t head = _head.load(std::memory_order_relaxed);
+    if (head == _tail.load(std::memory_order_acquire)) {
+      return false;
+    }
+    *item = _items[head & (CAPACITY - 1)];
+    _head.store(head + 1, std::memory_order_release);
+    return true;
+  }
+
+  size_t size() const
+  {
+    return _tail.load(std::memory_order_acquire) -
+      _head.load(std::memory_order_acquire);
+  }
+private:
+  T _items[CAPACITY];
+  std::atomic<uint32_t> _head{0};
+  std::atomic<uint32_t> _tail{0};
+};
+
+#endif /* SPSC_RING_HPP */
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
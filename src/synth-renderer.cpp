@@ -0,0 +1,353 @@
+/*
+ * Synth Renderer of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#include "synth-renderer.hpp"
+#ifdef USE_INTERP_OSC
+#include "hardware/interp.h"
+#endif
+
+const uint32_t
+Synth_renderer::MIX_BUFFER_FRAMES;
+
+Synth_renderer::Synth_renderer(MIDI_state_machine *const midi_state_machine)
+  : _midi_state_machine(midi_state_machine)
+{
+}
+
+Synth_renderer::~Synth_renderer()
+{
+}
+
+Mix_bus *
+Synth_renderer::get_mix_bus()
+{
+  return &_mix_bus;
+}
+
+uint64_t
+Synth_renderer::get_sample_time() const
+{
+  return _sample_time;
+}
+
+/*
+ * Step envelopes or LFOs if on one of their ticks, apply all events
+ * due at the current sample time, and return the number of frames
+ * that can be rendered before the next pending event is due, but no
+ * more than fit into the mix buffers.  While any envelope is ramping
+ * or any LFO is modulating, blocks also end at the next respective
+ * tick; otherwise, blocks are as long as without them.
+ */
+uint32_t
+Synth_renderer::next_block_frames(const uint32_t remaining_frames)
+{
+  const uint32_t tick_mask = MIDI_state_machine::ENVELOPE_TICK_FRAMES - 1;
+  const uint32_t tick_phase = (uint32_t)_sample_time & tick_mask;
+  if (!tick_phase) {
+    _midi_state_machine->update_envelopes();
+  }
+  const uint32_t lfo_tick_mask = MIDI_state_machine::LFO_TICK_FRAMES - 1;
+  const uint32_t lfo_tick_phase = (uint32_t)_sample_time & lfo_tick_mask;
+  if (!lfo_tick_phase) {
+    _midi_state_machine->update_lfos();
+  }
+  const uint64_t next_event_time =
+    _midi_state_machine->consume_posted_events(_sample_time);
+  uint32_t block_frames = remaining_frames;
+  if (block_frames > MIX_BUFFER_FRAMES) {
+    block_frames = MIX_BUFFER_FRAMES;
+  }
+  if (next_event_time - _sample_time < block_frames) {
+    block_frames = next_event_time - _sample_time;
+  }
+  if (_midi_state_machine->has_ramping_voices()) {
+    const uint32_t tick_frames =
+      MIDI_state_machine::ENVELOPE_TICK_FRAMES - tick_phase;
+    if (tick_frames < block_frames) {
+      block_frames = tick_frames;
+    }
+  }
+  if (_midi_state_machine->has_lfo_modulation()) {
+    const uint32_t lfo_tick_frames =
+      MIDI_state_machine::LFO_TICK_FRAMES - lfo_tick_phase;
+    if (lfo_tick_frames < block_frames) {
+      block_frames = lfo_tick_frames;
+    }
+  }
+  return block_frames;
+}
+
+#ifdef USE_INTERP_OSC
+/*
+ * Set up interp0 of the rendering core (which is not used otherwise)
+ * such that a single pop of lane 1 both advances an oscillator's
+ * phase and yields its sign: lane 0 adds the phase increment in BASE0
+ * to the phase in ACCUM0, and lane 1 adds the upper 31 bits of ACCUM0
+ * to BASE1 = 2^31 - pulse_width / 2, such that bit 31 of its result
+ * is set exactly when phase >= pulse_width (pulse widths are even).
+ * Popping returns the result for the current phase and writes the
+ * advanced one back into ACCUM0.
+ */
+static_assert(MIDI_state_machine::DUTY_BITS < 32,
+              "interpolator sign requires even pulse widths");
+
+void
+Synth_renderer::configure_interp()
+{
+  interp_config phase_config = interp_default_config();
+  interp_set_config(interp0, 0, &phase_config);
+  interp_config sign_config = interp_default_config();
+  interp_config_set_cross_input(&sign_config, true);
+  interp_config_set_shift(&sign_config, 1);
+  interp_config_set_mask(&sign_config, 0, 30);
+  interp_set_config(interp0, 1, &sign_config);
+}
+#endif
+
+#ifdef USE_DDS_OSC
+/*
+ * Phase accumulator oscillators: the sign of each sample is whether
+ * the oscillator's phase has reached its pulse width, applied to the
+ * magnitudes without a branch as (elongation ^ sign) - sign, with
+ * sign being either 0 or -1.
+ */
+void
+Synth_renderer::mix_phases(const uint32_t frame_count)
+{
+  MIDI_state_machine::osc_bank_t *osc_bank =
+    _midi_state_machine->get_osc_bank();
+  const uint8_t *active_oscs = _midi_state_machine->get_active_oscs();
+  const size_t active_osc_count = _midi_state_machine->get_active_osc_count();
+  int32_t *mix_left = &_mix_buffer_left[0];
+  int32_t *mix_right = &_mix_buffer_right[0];
+  for (uint32_t frame = 0; frame < frame_count; frame++) {
+    mix_left[frame] = 0;
+    mix_right[frame] = 0;
+  }
+#ifdef USE_INTERP_OSC
+  configure_interp();
+#endif
+  for (size_t active = 0; active < active_osc_count; active++) {
+    const uint8_t osc = active_oscs[active];
+    const uint32_t phase_inc = osc_bank->phase_inc[osc];
+    const uint32_t pulse_width = osc_bank->pulse_width[osc];
+    const int32_t elongation_left = osc_bank->elongation_left[osc];
+    const int32_t elongation_right = osc_bank->elongation_right[osc];
+#ifdef USE_INTERP_OSC
+    // ACCUM0 runs one increment ahead of the phase of the next sample
+    interp_set_base(interp0, 0, phase_inc);
+    interp_set_base(interp0, 1, 0x80000000u - (pulse_width >> 1));
+    interp_set_accumulator(interp0, 0, osc_bank->phase[osc] + phase_inc);
+    for (uint32_t frame = 0; frame < frame_count; frame++) {
+      const int32_t sign = (int32_t)interp_pop_lane_result(interp0, 1) >> 31;
+      mix_left[frame] += (elongation_left ^ sign) - sign;
+      mix_right[frame] += (elongation_right ^ sign) - sign;
+    }
+    osc_bank->phase[osc] = interp_get_accumulator(interp0, 0) - phase_inc;
+#else
+    uint32_t phase = osc_bank->phase[osc];
+    for (uint32_t frame = 0; frame < frame_count; frame++) {
+      phase += phase_inc;
+      const int32_t sign = -(int32_t)(phase >= pulse_width);
+      mix_left[frame] += (elongation_left ^ sign) - sign;
+      mix_right[frame] += (elongation_right ^ sign) - sign;
+    }
+    osc_bank->phase[osc] = phase;
+#endif
+  }
+}
+#else
+/*
+ * A square wave oscillator only changes its output when its count
+ * crosses count_wrap.  Hence, rather than stepping each oscillator
+ * once per sample, compute for each active oscillator the number of
+ * samples up to its next toggle and add its constant elongations
+ * into the left and right mix buffers over that whole span.  The
+ * resulting samples and oscillator states are exactly the same as
+ * with render_per_sample().
+ */
+void
+Synth_renderer::mix_spans(const uint32_t frame_count)
+{
+  MIDI_state_machine::osc_bank_t *osc_bank =
+    _midi_state_machine->get_osc_bank();
+  const uint8_t *active_oscs = _midi_state_machine->get_active_oscs();
+  const size_t active_osc_count = _midi_state_machine->get_active_osc_count();
+  const uint32_t count_inc = MIDI_state_machine::COUNT_INC;
+  const uint8_t count_inc_bits = MIDI_state_machine::COUNT_HEADROOM_BITS;
+  int32_t *mix_left = &_mix_buffer_left[0];
+  int32_t *mix_right = &_mix_buffer_right[0];
+  for (uint32_t frame = 0; frame < frame_count; frame++) {
+    mix_left[frame] = 0;
+    mix_right[frame] = 0;
+  }
+  for (size_t active = 0; active < active_osc_count; active++) {
+    const uint8_t osc = active_oscs[active];
+    uint32_t count_wrap = osc_bank->count_wrap[osc];
+    uint32_t count_wrap_next = osc_bank->count_wrap_next[osc];
+    uint32_t count = osc_bank->count[osc];
+    int32_t elongation_left = osc_bank->elongation_left[osc];
+    int32_t elongation_right = osc_bank->elongation_right[osc];
+    uint32_t frame = 0;
+    while (frame < frame_count) {
+      // number of count increments up to and including the toggle
+      const uint32_t count_gap = count < count_wrap ? count_wrap - count : 0;
+      uint32_t steps = (count_gap + count_inc - 1) >> count_inc_bits;
+      if (!steps) {
+        steps = 1;
+      }
+      const uint32_t span = steps - 1;
+      const uint32_t remaining = frame_count - frame;
+      const uint32_t end = span >= remaining ? frame_count : frame + span;
+      for (; frame < end; frame++) {
+        mix_left[frame] += elongation_left;
+        mix_right[frame] += elongation_right;
+      }
+      if (span >= remaining) {
+        count += remaining * count_inc;
+        break;
+      }
+      count += steps * count_inc - count_wrap;
+      const uint32_t count_wrap_prev = count_wrap;
+      count_wrap = count_wrap_next;
+      count_wrap_next = count_wrap_prev;
+      elongation_left = -elongation_left;
+      elongation_right = -elongation_right;
+      mix_left[frame] += elongation_left;
+      mix_right[frame] += elongation_right;
+      frame++;
+    }
+    osc_bank->count_wrap[osc] = count_wrap;
+    osc_bank->count_wrap_next[osc] = count_wrap_next;
+    osc_bank->count[osc] = count;
+    osc_bank->elongation_left[osc] = elongation_left;
+    osc_bank->elongation_right[osc] = elongation_right;
+  }
+}
+#endif
+
+void
+Synth_renderer::render(int16_t *out, const uint32_t frame_count,
+                       const bool stereo)
+{
+  const uint32_t channel_count = stereo ? 2 : 1;
+  _mix_bus.reset_meters();
+  for (uint32_t frame = 0; frame < frame_count;) {
+    const uint32_t block_frames = next_block_frames(frame_count - frame);
+#ifdef USE_DDS_OSC
+    mix_phases(block_frames);
+#else
+    mix_spans(block_frames);
+#endif
+    _midi_state_machine->get_percussion_bank()->mix(&_mix_buffer_left[0],
+                                                    &_mix_buffer_right[0],
+                                                    block_frames);
+    _mix_bus.write_out(&_mix_buffer_left[0], &_mix_buffer_right[0],
+                       out + frame * channel_count, block_frames, stereo);
+    frame += block_frames;
+    _sample_time += block_frames;
+  }
+}
+
+/*
+ * Reference renderer that steps every active oscillator once per
+ * sample; it feeds the same mix bus as render().
+ */
+void
+Synth_renderer::render_per_sample(int16_t *out, const uint32_t frame_count,
+                                  const bool stereo)
+{
+#ifndef USE_DDS_OSC
+  const uint32_t count_inc = MIDI_state_machine::COUNT_INC;
+#endif
+  MIDI_state_machine::osc_bank_t *osc_bank =
+    _midi_state_machine->get_osc_bank();
+  const uint8_t *active_oscs = _midi_state_machine->get_active_oscs();
+  const uint32_t channel_count = stereo ? 2 : 1;
+  _mix_bus.reset_meters();
+  for (uint32_t frame = 0; frame < frame_count;) {
+    const uint32_t block_frames = next_block_frames(frame_count - frame);
+    // events and envelopes may have (de)activated oscillators
+    const size_t active_osc_count =
+      _midi_state_machine->get_active_osc_count();
+    for (uint32_t block_frame = 0; block_frame < block_frames; block_frame++) {
+      int32_t sample_value_left = 0;
+      int32_t sample_value_right = 0;
+      for (size_t active = 0; active < active_osc_count; active++) {
+        const uint8_t osc = active_oscs[active];
+#ifdef USE_DDS_OSC
+        const uint32_t phase = osc_bank->phase[osc] + osc_bank->phase_inc[osc];
+        osc_bank->phase[osc] = phase;
+        const bool negative = phase >= osc_bank->pulse_width[osc];
+        const int32_t elongation_left = osc_bank->elongation_left[osc];
+        const int32_t elongation_right = osc_bank->elongation_right[osc];
+        sample_value_left += negative ? -elongation_left : elongation_left;
+        sample_value_right += negative ? -elongation_right : elongation_right;
+#else
+        int32_t elongation_left = osc_bank->elongation_left[osc];
+        int32_t elongation_right = osc_bank->elongation_right[osc];
+        const uint32_t count_wrap = osc_bank->count_wrap[osc];
+        uint32_t count = osc_bank->count[osc];
+        count += count_inc;
+        if (count >= count_wrap) {
+          count -= count_wrap;
+          osc_bank->count_wrap[osc] = osc_bank->count_wrap_next[osc];
+          osc_bank->count_wrap_next[osc] = count_wrap;
+          elongation_left = -elongation_left;
+          elongation_right = -elongation_right;
+          osc_bank->elongation_left[osc] = elongation_left;
+          osc_bank->elongation_right[osc] = elongation_right;
+        }
+        osc_bank->count[osc] = count;
+        sample_value_left += elongation_left;
+        sample_value_right += elongation_right;
+#endif
+      }
+      _mix_buffer_left[block_frame] = sample_value_left;
+      _mix_buffer_right[block_frame] = sample_value_right;
+    }
+    _midi_state_machine->get_percussion_bank()->mix(&_mix_buffer_left[0],
+                                                    &_mix_buffer_right[0],
+                                                    block_frames);
+    _mix_bus.write_out(&_mix_buffer_left[0], &_mix_buffer_right[0],
+                       out + frame * channel_count, block_frames, stereo);
+    frame += block_frames;
+    _sample_time += block_frames;
+  }
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,81 @@
+/*
+ * Synth Renderer of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#ifndef SYNTH_RENDERER_HPP
+#define SYNTH_RENDERER_HPP
+
+#include <cstddef>
+#include <cstdint>
+#include "midi-state-machine.hpp"
+#include "mix-bus.hpp"
+
+/*
+ * Mixes the square wave oscillators of the MIDI state machine into
+ * blocks of signed 16 bit output samples.  The renderer does not
+ * depend on any hardware, such that it can also be run and
+ * benchmarked on a host machine.
+ */
+class Synth_renderer {
+public:
+  static const uint32_t MIX_BUFFER_FRAMES = 256;
+  Synth_renderer(MIDI_state_machine *const midi_state_machine);
+  virtual ~Synth_renderer();
+  void render(int16_t *out, const uint32_t frame_count, const bool stereo);
+  void render_per_sample(int16_t *out, const uint32_t frame_count,
+                         const bool stereo);
+  Mix_bus *get_mix_bus();
+  uint64_t get_sample_time() const;
+private:
+  MIDI_state_machine *const _midi_state_machine;
+  uint64_t _sample_time = 0; // index of next output sample
+  Mix_bus _mix_bus;
+  int32_t _mix_buffer_left[MIX_BUFFER_FRAMES];
+  int32_t _mix_buffer_right[MIX_BUFFER_FRAMES];
+#ifdef USE_INTERP_OSC
+  void configure_interp();
+#endif
+#ifdef USE_DDS_OSC
+  void mix_phases(const uint32_t frame_count);
+#else
+  void mix_spans(const uint32_t frame_count);
+#endif
+  uint32_t next_block_frames(const uint32_t remaining_frames);
+};
+
+#endif /* SYNTH_RENDERER_HPP */
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,166 @@
+/*
+ * USB MIDI Source of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#include "usb-midi-source.hpp"
+#include "pico/stdlib.h"
+#include "bsp/board.h"
+#include "tusb.h"
+
+// Beyond the latency of the audio output, allow for the time between
+// the arrival of a transfer and the renderer's next visit to the
+// event queue.
+#define RX_JITTER_MARGIN_US 10000
+
+USB_MIDI_source *
+USB_MIDI_source::_rx_source = nullptr;
+
+USB_MIDI_source::USB_MIDI_source(MIDI_state_machine *const midi_state_machine)
+  : _midi_state_machine(midi_state_machine)
+{
+}
+
+USB_MIDI_source::~USB_MIDI_source()
+{
+}
+
+void
+USB_MIDI_source::init()
+{
+  _timestamp_active_sensing = time_us_64();
+  _rx_source = this;
+  board_init();
+  tusb_init();
+}
+
+void
+USB_MIDI_source::set_sample_clock(Sample_clock *const sample_clock)
+{
+  _sample_clock = sample_clock;
+}
+
+/*
+ * With a sample clock, received events are delayed by the latency of
+ * the audio output plus a margin, rather than applied as soon as
+ * possible, such that they keep the relative timing of the USB
+ * transfers they arrived in.  May be called from any core, e.g.
+ * after a sample rate switch.
+ */
+void
+USB_MIDI_source::set_output_latency_us(const uint32_t output_latency_us)
+{
+  _rx_latency_us.store(output_latency_us + RX_JITTER_MARGIN_US,
+                       std::memory_order_relaxed);
+}
+
+/*
+ * TinyUSB calls tud_midi_rx_cb() from within tud_task() for each
+ * transfer it has received, see rx_transfer().
+ */
+void
+USB_MIDI_source::rx_task()
+{
+  tud_task();
+}
+
+/*
+ * Drain the packets of the transfer just received, and post them as
+ * a batch, all stamped with the time the transfer was handed over by
+ * tud_task().  A transfer carries whatever the host has queued for
+ * one USB frame (1ms at full speed), so stamps are exact to the time
+ * between the arrival of a transfer and the next call of rx_task().
+ * For the structure of the 4-byte packets, see "USB_MIDI Event
+ * Packets" in: USB device class definition
+ * (usb.org/sites/default/files/midi10.pdf), page 16.
+ */
+void
+USB_MIDI_source::rx_transfer()
+{
+  const uint64_t time_us = time_us_64();
+  const uint32_t latency_us = _rx_latency_us.load(std::memory_order_relaxed);
+  const uint64_t sample_time = _sample_clock ?
+    _sample_clock->to_sample_time(time_us + latency_us) : 0;
+  for (;;) {
+    size_t batch_size = 0;
+    while ((batch_size < RX_BATCH_SIZE) &&
+           tud_midi_packet_read(_rx_batch[batch_size])) {
+      batch_size++;
+    }
+    for (size_t index = 0; index < batch_size; index++) {
+      _midi_state_machine->post_event_packet(&_rx_batch[index][0],
+                                             sample_time);
+    }
+    if (batch_size < RX_BATCH_SIZE) {
+      return;
+    }
+  }
+}
+
+void
+tud_midi_rx_cb(__unused uint8_t itf)
+{
+  if (USB_MIDI_source::_rx_source) {
+    USB_MIDI_source::_rx_source->rx_transfer();
+  }
+}
+
+void
+USB_MIDI_source::produce_tx_data(uint8_t *buffer,
+                                 __unused const size_t max_buffer_size,
+                                 size_t *const buffer_size)
+{
+  /* when deadline for next active sensing has expired, produce a
+     packet containing a sensive acting MIDI code */
+  const uint64_t timestamp_now = time_us_64();
+  if (timestamp_now - _timestamp_active_sensing > 300000) {
+    _timestamp_active_sensing += 300000;
+    buffer[0] = 0xFE; // MIDI code for active sensing
+    *buffer_size = 1;
+  } else {
+    *buffer_size = 0;
+  }
+}
+
+void
+USB_MIDI_source::tx_task()
+{
+  static uint8_t tx_data_buffer[3];
+  size_t buffer_size;
+  produce_tx_data(tx_data_buffer, sizeof(tx_data_buffer), &buffer_size);
+  tud_midi_stream_write(0, tx_data_buffer, buffer_size);
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
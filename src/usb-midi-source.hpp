@@ -0,0 +1,75 @@
+/*
+ * USB MIDI Source of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+#ifndef USB_MIDI_SOURCE_HPP
+#define USB_MIDI_SOURCE_HPP
+
+#include <atomic>
+#include <cstddef>
+#include <cstdint>
+#include "midi-state-machine.hpp"
+#include "sample-clock.hpp"
+
+extern "C" void tud_midi_rx_cb(uint8_t itf);
+
+class USB_MIDI_source {
+public:
+  USB_MIDI_source(MIDI_state_machine *const midi_state_machine);
+  virtual ~USB_MIDI_source();
+  void init();
+  void set_sample_clock(Sample_clock *const sample_clock);
+  void set_output_latency_us(const uint32_t output_latency_us);
+  void rx_task();
+  void tx_task();
+private:
+  friend void ::tud_midi_rx_cb(uint8_t itf);
+  static const size_t RX_BATCH_SIZE = 0x10; // a full 64 byte RX FIFO
+  static USB_MIDI_source *_rx_source; // for tud_midi_rx_cb()
+  MIDI_state_machine *const _midi_state_machine;
+  Sample_clock *_sample_clock = nullptr;
+  std::atomic<uint32_t> _rx_latency_us{0};
+  uint8_t _rx_batch[RX_BATCH_SIZE][4];
+  uint64_t _timestamp_active_sensing;
+  void rx_transfer();
+  void produce_tx_data(uint8_t *buffer,
+                       const size_t max_buffer_size,
+                       size_t *const buffer_size);
+};
+
+#endif /* USB_MIDI_SOURCE_HPP */
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
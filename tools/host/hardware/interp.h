@@ -0,0 +1,282 @@
+/*
+ * Host replacement of the Pico SDK's hardware/interp.h: a software
+ * model of the RP2040 interpolators behind the SDK's own accessors,
+ * such that code driving interp0 or interp1 builds and runs
+ * unchanged on the host.
+ *
+ * Per lane, the (possibly crossed) accumulator is shifted right,
+ * masked, optionally sign extended from the mask's MSB, and added to
+ * the lane's base; with ADD_RAW, the unshifted, unmasked accumulator
+ * is added instead.  FORCE_MSB is ORed into bits 29:28 of the lane
+ * result.  The full result adds base 2 and both masked lane values.
+ * Popping any result writes both lane results (or, with CROSS_RESULT,
+ * the other lane's) back into the accumulators.  Blend and clamp
+ * modes and the overflow flags are not modelled.
+ */
+
+#ifndef HOST_HARDWARE_INTERP_H
+#define HOST_HARDWARE_INTERP_H
+
+#include <stdbool.h>
+#include <stdint.h>
+
+#define SIO_INTERP0_CTRL_LANE0_SHIFT_LSB 0
+#define SIO_INTERP0_CTRL_LANE0_SHIFT_BITS 0x0000001f
+#define SIO_INTERP0_CTRL_LANE0_MASK_LSB_LSB 5
+#define SIO_INTERP0_CTRL_LANE0_MASK_LSB_BITS 0x000003e0
+#define SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB 10
+#define SIO_INTERP0_CTRL_LANE0_MASK_MSB_BITS 0x00007c00
+#define SIO_INTERP0_CTRL_LANE0_SIGNED_BITS 0x00008000
+#define SIO_INTERP0_CTRL_LANE0_CROSS_INPUT_BITS 0x00010000
+#define SIO_INTERP0_CTRL_LANE0_CROSS_RESULT_BITS 0x00020000
+#define SIO_INTERP0_CTRL_LANE0_ADD_RAW_BITS 0x00040000
+#define SIO_INTERP0_CTRL_LANE0_FORCE_MSB_LSB 19
+#define SIO_INTERP0_CTRL_LANE0_FORCE_MSB_BITS 0x00180000
+
+typedef struct {
+  uint32_t accum[2];
+  uint32_t base[3];
+  uint32_t ctrl[2];
+} interp_hw_t;
+
+typedef struct {
+  uint32_t ctrl;
+} interp_config;
+
+typedef struct {
+  uint32_t accum[2];
+  uint32_t base[3];
+  uint32_t ctrl[2];
+} interp_hw_save_t;
+
+// one pair per translation unit, as interpolators are per core anyway
+static interp_hw_t host_interp_hw[2];
+
+#define interp0 (&host_interp_hw[0])
+#define interp1 (&host_interp_hw[1])
+
+static inline interp_config
+interp_default_config(void)
+{
+  interp_config config = { 0 };
+  config.ctrl = 31u << SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB;
+  return config;
+}
+
+static inline void
+interp_config_set_shift(interp_config *config, const unsigned int shift)
+{
+  config->ctrl = (config->ctrl & ~SIO_INTERP0_CTRL_LANE0_SHIFT_BITS) |
+    ((shift << SIO_INTERP0_CTRL_LANE0_SHIFT_LSB) &
+     SIO_INTERP0_CTRL_LANE0_SHIFT_BITS);
+}
+
+static inline void
+interp_config_set_mask(interp_config *config, const unsigned int mask_lsb,
+                       const unsigned int mask_msb)
+{
+  config->ctrl = (config->ctrl &
+                  ~(SIO_INTERP0_CTRL_LANE0_MASK_LSB_BITS |
+                    SIO_INTERP0_CTRL_LANE0_MASK_MSB_BITS)) |
+    ((mask_lsb << SIO_INTERP0_CTRL_LANE0_MASK_LSB_LSB) &
+     SIO_INTERP0_CTRL_LANE0_MASK_LSB_BITS) |
+    ((mask_msb << SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB) &
+     SIO_INTERP0_CTRL_LANE0_MASK_MSB_BITS);
+}
+
+static inline void
+host_interp_config_set_flag(interp_config *config, const uint32_t flag,
+                            const bool value)
+{
+  config->ctrl = value ? (config->ctrl | flag) : (config->ctrl & ~flag);
+}
+
+static inline void
+interp_config_set_cross_input(interp_config *config, const bool cross_input)
+{
+  host_interp_config_set_flag(config, SIO_INTERP0_CTRL_LANE0_CROSS_INPUT_BITS,
+                              cross_input);
+}
+
+static inline void
+interp_config_set_cross_result(interp_config *config,
+                               const bool cross_result)
+{
+  host_interp_config_set_flag(config,
+                              SIO_INTERP0_CTRL_LANE0_CROSS_RESULT_BITS,
+                              cross_result);
+}
+
+static inline void
+interp_config_set_signed(interp_config *config, const bool _signed)
+{
+  host_interp_config_set_flag(config, SIO_INTERP0_CTRL_LANE0_SIGNED_BITS,
+                              _signed);
+}
+
+static inline void
+interp_config_set_add_raw(interp_config *config, const bool add_raw)
+{
+  host_interp_config_set_flag(config, SIO_INTERP0_CTRL_LANE0_ADD_RAW_BITS,
+                              add_raw);
+}
+
+static inline void
+interp_config_set_force_bits(interp_config *config, const unsigned int bits)
+{
+  config->ctrl = (config->ctrl & ~SIO_INTERP0_CTRL_LANE0_FORCE_MSB_BITS) |
+    ((bits << SIO_INTERP0_CTRL_LANE0_FORCE_MSB_LSB) &
+     SIO_INTERP0_CTRL_LANE0_FORCE_MSB_BITS);
+}
+
+static inline void
+interp_set_config(interp_hw_t *interp, const unsigned int lane,
+                  interp_config *config)
+{
+  interp->ctrl[lane] = config->ctrl;
+}
+
+static inline void
+interp_set_base(interp_hw_t *interp, const unsigned int lane,
+                const uint32_t value)
+{
+  interp->base[lane] = value;
+}
+
+static inline uint32_t
+interp_get_base(interp_hw_t *interp, const unsigned int lane)
+{
+  return interp->base[lane];
+}
+
+static inline void
+interp_set_accumulator(interp_hw_t *interp, const unsigned int lane,
+                       const uint32_t value)
+{
+  interp->accum[lane] = value;
+}
+
+static inline uint32_t
+interp_get_accumulator(interp_hw_t *interp, const unsigned int lane)
+{
+  return interp->accum[lane];
+}
+
+static inline uint32_t
+host_interp_lane_input(const interp_hw_t *interp, const unsigned int lane)
+{
+  const bool cross_input =
+    interp->ctrl[lane] & SIO_INTERP0_CTRL_LANE0_CROSS_INPUT_BITS;
+  return interp->accum[cross_input ? 1 - lane : lane];
+}
+
+static inline uint32_t
+host_interp_lane_masked(const interp_hw_t *interp, const unsigned int lane)
+{
+  const uint32_t ctrl = interp->ctrl[lane];
+  const unsigned int shift =
+    (ctrl & SIO_INTERP0_CTRL_LANE0_SHIFT_BITS) >>
+    SIO_INTERP0_CTRL_LANE0_SHIFT_LSB;
+  const unsigned int mask_lsb =
+    (ctrl & SIO_INTERP0_CTRL_LANE0_MASK_LSB_BITS) >>
+    SIO_INTERP0_CTRL_LANE0_MASK_LSB_LSB;
+  const unsigned int mask_msb =
+    (ctrl & SIO_INTERP0_CTRL_LANE0_MASK_MSB_BITS) >>
+    SIO_INTERP0_CTRL_LANE0_MASK_MSB_LSB;
+  const uint32_t mask =
+    (0xffffffffu >> (31 - mask_msb)) & (0xffffffffu << mask_lsb);
+  uint32_t masked = (host_interp_lane_input(interp, lane) >> shift) & mask;
+  if ((ctrl & SIO_INTERP0_CTRL_LANE0_SIGNED_BITS) && (mask_msb < 31) &&
+      (masked & (1u << mask_msb))) {
+    masked |= 0xffffffffu << (mask_msb + 1);
+  }
+  return masked;
+}
+
+static inline uint32_t
+host_interp_lane_result(const interp_hw_t *interp, const unsigned int lane)
+{
+  const uint32_t ctrl = interp->ctrl[lane];
+  const uint32_t value =
+    (ctrl & SIO_INTERP0_CTRL_LANE0_ADD_RAW_BITS) ?
+    host_interp_lane_input(interp, lane) :
+    host_interp_lane_masked(interp, lane);
+  const uint32_t force_msb =
+    (ctrl & SIO_INTERP0_CTRL_LANE0_FORCE_MSB_BITS) >>
+    SIO_INTERP0_CTRL_LANE0_FORCE_MSB_LSB;
+  return (interp->base[lane] + value) | (force_msb << 28);
+}
+
+static inline uint32_t
+host_interp_full_result(const interp_hw_t *interp)
+{
+  return interp->base[2] + host_interp_lane_masked(interp, 0) +
+    host_interp_lane_masked(interp, 1);
+}
+
+static inline void
+host_interp_write_back(interp_hw_t *interp)
+{
+  const uint32_t result0 = host_interp_lane_result(interp, 0);
+  const uint32_t result1 = host_interp_lane_result(interp, 1);
+  interp->accum[0] =
+    (interp->ctrl[0] & SIO_INTERP0_CTRL_LANE0_CROSS_RESULT_BITS) ?
+    result1 : result0;
+  interp->accum[1] =
+    (interp->ctrl[1] & SIO_INTERP0_CTRL_LANE0_CROSS_RESULT_BITS) ?
+    result0 : result1;
+}
+
+static inline uint32_t
+interp_peek_lane_result(interp_hw_t *interp, const unsigned int lane)
+{
+  return host_interp_lane_result(interp, lane);
+}
+
+static inline uint32_t
+interp_pop_lane_result(interp_hw_t *interp, const unsigned int lane)
+{
+  const uint32_t result = host_interp_lane_result(interp, lane);
+  host_interp_write_back(interp);
+  return result;
+}
+
+static inline uint32_t
+interp_peek_full_result(interp_hw_t *interp)
+{
+  return host_interp_full_result(interp);
+}
+
+static inline uint32_t
+interp_pop_full_result(interp_hw_t *interp)
+{
+  const uint32_t result = host_interp_full_result(interp);
+  host_interp_write_back(interp);
+  return result;
+}
+
+static inline void
+interp_save(interp_hw_t *interp, interp_hw_save_t *saver)
+{
+  for (unsigned int lane = 0; lane < 2; lane++) {
+    saver->accum[lane] = interp->accum[lane];
+    saver->ctrl[lane] = interp->ctrl[lane];
+  }
+  for (unsigned int lane = 0; lane < 3; lane++) {
+    saver->base[lane] = interp->base[lane];
+  }
+}
+
+static inline void
+interp_restore(interp_hw_t *interp, interp_hw_save_t *saver)
+{
+  for (unsigned int lane = 0; lane < 2; lane++) {
+    interp->accum[lane] = saver->accum[lane];
+    interp->ctrl[lane] = saver->ctrl[lane];
+  }
+  for (unsigned int lane = 0; lane < 3; lane++) {
+    interp->base[lane] = saver->base[lane];
+  }
+}
+
+#endif /* HOST_HARDWARE_INTERP_H */
@@ -0,0 +1,10 @@
+/*
+ * Host replacement of the Pico SDK's hardware/platform_defs.h.
+ */
+
+#ifndef HOST_HARDWARE_PLATFORM_DEFS_H
+#define HOST_HARDWARE_PLATFORM_DEFS_H
+
+#define _u(x) x ## u
+
+#endif /* HOST_HARDWARE_PLATFORM_DEFS_H */
@@ -0,0 +1,22 @@
+/*
+ * Virtual time of the host tools, in microseconds since (virtual)
+ * power-up; the tool driving the synth advances it.
+ */
+
+#ifndef HOST_CLOCK_HPP
+#define HOST_CLOCK_HPP
+
+#include <stdint.h>
+
+#ifdef __cplusplus
+extern "C" {
+#endif
+
+uint64_t host_time_us(void);
+void host_set_time_us(const uint64_t time_us);
+
+#ifdef __cplusplus
+}
+#endif
+
+#endif /* HOST_CLOCK_HPP */
@@ -0,0 +1,140 @@
+/*
+ * Host Shims of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+/*
+ * Stand-ins for the hardware dependent parts (clock, WiFi, NTP,
+ * display and LEDs) that the network source pulls in, such that the
+ * very same network source can be driven by host tools.  Display and
+ * LED output is discarded; time is virtual.
+ */
+
+#include <cstring>
+#include "pico/stdlib.h"
+#include "pico/unique_id.h"
+#include "display.h"
+#include "led.h"
+#include "ntp.hpp"
+#include "tlv.h"
+#include "wifi-stuff.hpp"
+
+static uint64_t host_time = 0;
+
+uint64_t
+host_time_us(void)
+{
+  return host_time;
+}
+
+void
+host_set_time_us(const uint64_t time_us)
+{
+  host_time = time_us;
+}
+
+void
+pico_get_unique_board_id(pico_unique_board_id_t *id_out)
+{
+  memset(id_out, 0, sizeof(*id_out));
+}
+
+circular_buffer8 udp_buffer = { .data = {{0}}, .head = 0, .tail = 0, .count = 0 };
+
+int
+init_wifi_stuff(void)
+{
+  return 0;
+}
+
+void
+close_wifi_stuff(void)
+{
+}
+
+NTP_client::NTP_client() : powerup_time(0), run(false)
+{
+}
+
+NTP_client::~NTP_client()
+{
+}
+
+void
+NTP_client::update_time()
+{
+}
+
+int SSD1306_HEIGHT = LARGE_DISPLAY_HEIGHT;
+int SSD1306_NUM_PAGES = LARGE_DISPLAY_HEIGHT / SSD1306_PAGE_HEIGHT;
+int SSD1306_BUF_LEN = SSD1306_WIDTH * LARGE_DISPLAY_HEIGHT / SSD1306_PAGE_HEIGHT;
+static uint8_t host_display_buffer[SSD1306_WIDTH * LARGE_DISPLAY_HEIGHT /
+                                   SSD1306_PAGE_HEIGHT];
+uint8_t *display_buffer = host_display_buffer;
+render_area_t full_frame_area = {
+  .start_col = 0,
+  .end_col = SSD1306_WIDTH - 1,
+  .start_page = 0,
+  .end_page = LARGE_DISPLAY_HEIGHT / SSD1306_PAGE_HEIGHT - 1,
+  .buflen = sizeof(host_display_buffer),
+};
+
+void set_pixel(int, int, bool) {}
+void draw_line(int, int, int, int, bool) {}
+void draw_line_vertical(int, int, int, bool) {}
+void draw_line_horizontal(int, int, int, bool) {}
+void draw_rect(int, int, int, int, bool) {}
+void scroll_down(int) {}
+bool is_large_display(void) { return true; }
+void write_string(int16_t, int16_t, const char *) {}
+void render(render_area_t *) {}
+void render_full(void) {}
+void init_display(void) {}
+
+uint8_t led_data[NUM_LEDS][4];
+
+void init_leds(void) {}
+void update_leds(void) {}
+void scroll_down_leds(void) {}
+void set_first_led(uint8_t, uint8_t, uint8_t) {}
+void set_led(int, uint8_t, uint8_t, uint8_t) {}
+
+void
+hue2rgb(uint8_t, uint8_t *r, uint8_t *g, uint8_t *b)
+{
+  *r = *g = *b = 0;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */
@@ -0,0 +1,15 @@
+/*
+ * Host replacement of lwIP's lwip/pbuf.h, declaring the types that
+ * appear in the NTP client's interface.
+ */
+
+#ifndef HOST_LWIP_PBUF_H
+#define HOST_LWIP_PBUF_H
+
+#include <stdint.h>
+
+typedef uint16_t u16_t;
+
+struct pbuf;
+
+#endif /* HOST_LWIP_PBUF_H */
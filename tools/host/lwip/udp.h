@@ -0,0 +1,18 @@
+/*
+ * Host replacement of lwIP's lwip/udp.h, declaring the types that
+ * appear in the NTP client's interface.
+ */
+
+#ifndef HOST_LWIP_UDP_H
+#define HOST_LWIP_UDP_H
+
+#include <stdint.h>
+#include "lwip/pbuf.h"
+
+typedef struct {
+  uint32_t addr;
+} ip_addr_t;
+
+struct udp_pcb;
+
+#endif /* HOST_LWIP_UDP_H */
@@ -0,0 +1,11 @@
+/*
+ * Host replacement of the Pico SDK's pico/critical_section.h; the
+ * host tools are single threaded.
+ */
+
+#ifndef HOST_PICO_CRITICAL_SECTION_H
+#define HOST_PICO_CRITICAL_SECTION_H
+
+#include "pico/stdlib.h"
+
+#endif /* HOST_PICO_CRITICAL_SECTION_H */
@@ -0,0 +1,9 @@
+/*
+ * Host replacement of the Pico SDK's pico/cyw43_arch.h; there is no
+ * WiFi chip on the host.
+ */
+
+#ifndef HOST_PICO_CYW43_ARCH_H
+#define HOST_PICO_CYW43_ARCH_H
+
+#endif /* HOST_PICO_CYW43_ARCH_H */
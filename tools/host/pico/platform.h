@@ -0,0 +1,14 @@
+/*
+ * Host replacement of the Pico SDK's pico/platform.h, providing just
+ * what the synth sources use.
+ */
+
+#ifndef HOST_PICO_PLATFORM_H
+#define HOST_PICO_PLATFORM_H
+
+static inline void
+tight_loop_contents(void)
+{
+}
+
+#endif /* HOST_PICO_PLATFORM_H */
@@ -0,0 +1,42 @@
+/*
+ * Host replacement of the Pico SDK's pico/stdlib.h, providing just
+ * what the synth sources use; time is virtual (see host-clock.hpp).
+ */
+
+#ifndef HOST_PICO_STDLIB_H
+#define HOST_PICO_STDLIB_H
+
+#include <stdbool.h>
+#include <stdint.h>
+#include <stdio.h>
+#include "host-clock.hpp"
+
+typedef unsigned int uint;
+typedef uint64_t absolute_time_t;
+typedef int32_t alarm_id_t;
+
+static inline absolute_time_t
+get_absolute_time(void)
+{
+  return host_time_us();
+}
+
+static inline uint64_t
+time_us_64(void)
+{
+  return host_time_us();
+}
+
+static inline uint32_t
+save_and_disable_interrupts(void)
+{
+  return 0;
+}
+
+static inline void
+restore_interrupts(const uint32_t status)
+{
+  (void)status;
+}
+
+#endif /* HOST_PICO_STDLIB_H */
@@ -0,0 +1,16 @@
+/*
+ * Host replacement of the Pico SDK's pico/unique_id.h.
+ */
+
+#ifndef HOST_PICO_UNIQUE_ID_H
+#define HOST_PICO_UNIQUE_ID_H
+
+#include <stdint.h>
+
+typedef struct {
+  uint8_t id[8];
+} pico_unique_board_id_t;
+
+void pico_get_unique_board_id(pico_unique_board_id_t *id_out);
+
+#endif /* HOST_PICO_UNIQUE_ID_H */
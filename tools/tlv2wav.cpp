@@ -0,0 +1,287 @@
+/*
+ * TLV to WAV Renderer of Simple Stupid Synthesizer
+ *
+ * Copyright (C) 2023 Jürgen Reuter
+ *
+ * This file is free software; you can redistribute it and/or modify
+ * it under the terms of the GNU General Public License as published
+ * by the Free Software Foundation; either version 2 of the License,
+ * or (at your option) any later version.
+ *
+ * This program is distributed in the hope that it will be useful, but
+ * WITHOUT ANY WARRANTY; without even the implied warranty of
+ * MERCHANTABILITY or FITNESS FOR A PARTICULAR PURPOSE.  See the GNU
+ * General Public License for more details.
+ *
+ * You should have received a copy of the GNU General Public License
+ * along with this program; if not, write to the Free Software
+ * Foundation, Inc., 59 Temple Place - Suite 330, Boston, MA
+ * 02111-1307, USA.
+ *
+ * As a special exception to the GNU General Public License, if you
+ * distribute this file as part of a program that contains a
+ * configuration script generated by Autoconf, you may include it
+ * under the same distribution terms that you use for the rest of that
+ * program.
+ *
+ * For updates and more info or contacting the author, visit:
+ * <https://github.com/soundpaint>
+ *
+ * Author's web site: www.juergen-reuter.de
+ */
+
+/*
+ * Offline renderer: feeds a captured stream of TLV packets through
+ * the firmware's own network source, note scheduler, MIDI state
+ * machine and synth renderer, driven by a virtual clock, and writes
+ * the output sample-exactly to a stereo 16 bit WAV file, as fast as
+ * the host can render.
+ *
+ * The capture is a sequence of records, each consisting of the
+ * packet's arrival time in microseconds since capture start (uint64_t,
+ * little endian), followed by the TLV packet as received via UDP
+ * (type, length and payload, with the length covering the header).
+ */
+
+#include <chrono>
+#include <cstdio>
+#include <cstdlib>
+#include <cstring>
+#include <unistd.h>
+#include <vector>
+#include "pico/stdlib.h"
+#include "midi-state-machine.hpp"
+#include "network-source.hpp"
+#include "ntp.hpp"
+#include "sample-clock.hpp"
+#include "synth-renderer.hpp"
+#include "tlv.h"
+#include "wifi-stuff.hpp"
+
+static const uint32_t DEFAULT_SAMPLE_FREQ = 24000; // [Hz]
+static const uint32_t BUFFER_FRAMES = 256;
+static const uint64_t TAIL_US = 1000000; // render past the last note
+
+typedef struct {
+  uint64_t arrival_us;
+  const uint8_t *packet;
+} record_t;
+
+static bool
+read_capture(const char *path, std::vector<uint8_t> *data,
+             std::vector<record_t> *records)
+{
+  FILE *file = fopen(path, "rb");
+  if (!file) {
+    perror(path);
+    return false;
+  }
+  uint8_t chunk[0x1000];
+  size_t length;
+  while ((length = fread(chunk, 1, sizeof(chunk), file)) > 0) {
+    data->insert(data->end(), chunk, chunk + length);
+  }
+  fclose(file);
+  size_t offset = 0;
+  while (offset < data->size()) {
+    if (data->size() - offset < sizeof(uint64_t) + TLV_HEADER_LENGTH) {
+      fprintf(stderr, "%s: truncated record at offset %zu\n", path, offset);
+      return false;
+    }
+    record_t record;
+    record.arrival_us = 0;
+    for (size_t byte = 0; byte < sizeof(uint64_t); byte++) {
+      record.arrival_us |= ((uint64_t)(*data)[offset + byte]) << (8 * byte);
+    }
+    offset += sizeof(uint64_t);
+    record.packet = &(*data)[offset];
+    const uint8_t packet_length = ((const tlv_header_t *)record.packet)->len;
+    if ((packet_length < TLV_HEADER_LENGTH) ||
+        (packet_length > data->size() - offset)) {
+      fprintf(stderr, "%s: bad packet length %u at offset %zu\n",
+              path, packet_length, offset);
+      return false;
+    }
+    offset += packet_length;
+    records->push_back(record);
+  }
+  return true;
+}
+
+/*
+ * Returns the latest time stamp (in us since 1900) carried by the
+ * packet, or 0 for packets without time stamp.
+ */
+static uint64_t
+packet_time(const tlv_packet_t *packet)
+{
+  switch (packet->header.type) {
+  case TLV_TYPE_NOTE_ON:
+  case TLV_TYPE_NOTE_OFF:
+    return ((const tlv_type_note_on_t *)packet->payload)->us_since_1900;
+  case TLV_TYPE_NOTE_ON_OFF:
+    return ((const tlv_type_note_on_off_t *)packet->payload)->off;
+  case TLV_TYPE_CHORD:
+    return ((const tlv_type_chord_t *)packet->payload)->off;
+  case TLV_TYPE_START:
+    return ((const tlv_type_start_t *)packet->payload)->us_since_1900;
+  default:
+    return 0;
+  }
+}
+
+static void
+write_le(FILE *file, const uint32_t value, const size_t size)
+{
+  for (size_t byte = 0; byte < size; byte++) {
+    fputc((value >> (8 * byte)) & 0xff, file);
+  }
+}
+
+static void
+write_wav_header(FILE *file, const uint32_t sample_freq,
+                 const uint32_t frame_count)
+{
+  const uint16_t channel_count = 2;
+  const uint16_t block_align = channel_count * sizeof(int16_t);
+  const uint32_t data_size = frame_count * block_align;
+  fseek(file, 0, SEEK_SET);
+  fputs("RIFF", file);
+  write_le(file, 36 + data_size, 4);
+  fputs("WAVEfmt ", file);
+  write_le(file, 16, 4); // fmt chunk size
+  write_le(file, 1, 2); // PCM
+  write_le(file, channel_count, 2);
+  write_le(file, sample_freq, 4);
+  write_le(file, sample_freq * block_align, 4); // byte rate
+  write_le(file, block_align, 2);
+  write_le(file, 16, 2); // bits per sample
+  fputs("data", file);
+  write_le(file, data_size, 4);
+}
+
+static void
+usage(const char *program)
+{
+  fprintf(stderr,
+          "usage: %s [-r sample_freq] [-b board_id] capture.tlv out.wav\n",
+          program);
+}
+
+int
+main(int argc, char *argv[])
+{
+  uint32_t sample_freq = DEFAULT_SAMPLE_FREQ;
+  uint64_t board_id = 0;
+  int option;
+  while ((option = getopt(argc, argv, "r:b:")) != -1) {
+    switch (option) {
+    case 'r':
+      sample_freq = strtoul(optarg, NULL, 0);
+      break;
+    case 'b':
+      board_id = strtoull(optarg, NULL, 0);
+      break;
+    default:
+      usage(argv[0]);
+      return EXIT_FAILURE;
+    }
+  }
+  if (argc - optind != 2) {
+    usage(argv[0]);
+    return EXIT_FAILURE;
+  }
+  std::vector<uint8_t> data;
+  std::vector<record_t> records;
+  if (!read_capture(argv[optind], &data, &records)) {
+    return EXIT_FAILURE;
+  }
+
+  static MIDI_state_machine midi_state_machine;
+  if (!midi_state_machine.init(sample_freq)) {
+    fprintf(stderr, "unsupported sample rate %u Hz\n", sample_freq);
+    return EXIT_FAILURE;
+  }
+  static NTP_client ntp;
+  static Network_source network_source(&midi_state_machine);
+  static Sample_clock sample_clock;
+  static Synth_renderer renderer(&midi_state_machine);
+  network_source.set_ntp(&ntp);
+  network_source.set_sample_clock(&sample_clock);
+  sample_clock.set_anchor(0, 0,
+                          Sample_clock::get_frames_per_us(sample_freq));
+  network_source.set_board_id(board_id);
+  network_source.set_tlv_callback(TLV_TYPE_SAMPLE_FREQ, [](tlv_packet_t *) {
+    fprintf(stderr, "WARNING: ignoring sample rate switch\n");
+  });
+
+  FILE *wav = fopen(argv[optind + 1], "wb");
+  if (!wav) {
+    perror(argv[optind + 1]);
+    return EXIT_FAILURE;
+  }
+  write_wav_header(wav, sample_freq, 0);
+
+  // without a time packet up front, play the first time stamp on arrival
+  bool have_time = false;
+  uint64_t last_packet_time = 0;
+  size_t next_record = 0;
+  uint32_t frame_count = 0;
+  int16_t out[2 * BUFFER_FRAMES];
+  const auto start = std::chrono::steady_clock::now();
+  for (;;) {
+    const uint64_t now_us =
+      renderer.get_sample_time() * 1000000 / sample_freq;
+    host_set_time_us(now_us);
+    while ((next_record < records.size()) &&
+           (records[next_record].arrival_us <= now_us)) {
+      if (udp_buffer.count == UDP_BUFFER_SIZE) {
+        network_source.rx_task();
+      }
+      const record_t *record = &records[next_record++];
+      const tlv_packet_t *packet = (const tlv_packet_t *)record->packet;
+      const uint64_t time = packet_time(packet);
+      if (packet->header.type == TLV_TYPE_TIME) {
+        have_time = true;
+      } else if (time && !have_time) {
+        ntp.powerup_time = time - record->arrival_us;
+        have_time = true;
+      }
+      if (time > last_packet_time) {
+        last_packet_time = time;
+      }
+      memcpy(udp_buffer.data[udp_buffer.head], packet, packet->header.len);
+      udp_buffer.head = (udp_buffer.head + 1) % UDP_BUFFER_SIZE;
+      udp_buffer.count++;
+    }
+    network_source.rx_task();
+    if ((next_record == records.size()) &&
+        (ntp.powerup_time + now_us > last_packet_time + TAIL_US)) {
+      break;
+    }
+    renderer.render(out, BUFFER_FRAMES, true);
+    if (fwrite(out, sizeof(out), 1, wav) != 1) {
+      perror(argv[optind + 1]);
+      return EXIT_FAILURE;
+    }
+    frame_count += BUFFER_FRAMES;
+  }
+  const double elapsed_s = std::chrono::duration<double>
+    (std::chrono::steady_clock::now() - start).count();
+  write_wav_header(wav, sample_freq, frame_count);
+  fclose(wav);
+
+  const double audio_s = (double)frame_count / sample_freq;
+  fprintf(stderr, "%zu packets, %.1f s of audio rendered in %.2f s "
+          "(%.0fx real time), %u samples clipped\n",
+          records.size(), audio_s, elapsed_s, audio_s / elapsed_s,
+          renderer.get_mix_bus()->get_total_clipped_sample_count());
+  return EXIT_SUCCESS;
+}
+
+/*
+ * Local variables:
+ *   mode: c++
+ *  coding: utf-8
+ * End:
+ */